@@ -0,0 +1,62 @@
+/* appendbench.c
+
+   Measures sequential append throughput: creates an empty file
+   and grows it to KB kilobytes with writes of CHUNK bytes
+   (default 512).  Compare the tick counts and disk statistics
+   that Pintos prints at shutdown, e.g.
+
+        pintos -- -q -f run 'appendbench big 1024 4096'      */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+static char buf[16384];
+
+int
+main (int argc, char *argv[])
+{
+  int fd, kb, chunk, total, written;
+
+  if (argc != 3 && argc != 4)
+    {
+      printf ("usage: appendbench FILE KB [CHUNK]\n");
+      return EXIT_FAILURE;
+    }
+  kb = atoi (argv[2]);
+  chunk = argc == 4 ? atoi (argv[3]) : 512;
+  if (chunk <= 0 || chunk > (int) sizeof buf)
+    {
+      printf ("appendbench: CHUNK must be between 1 and %d\n",
+              (int) sizeof buf);
+      return EXIT_FAILURE;
+    }
+
+  if (!create (argv[1], 0))
+    {
+      printf ("appendbench: create %s failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  fd = open (argv[1]);
+  if (fd < 0)
+    {
+      printf ("appendbench: open %s failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  for (total = kb * 1024, written = 0; written < total; )
+    {
+      int size = total - written < chunk ? total - written : chunk;
+      if (write (fd, buf, size) != size)
+        {
+          printf ("appendbench: write failed at byte %d\n", written);
+          return EXIT_FAILURE;
+        }
+      written += size;
+    }
+  close (fd);
+
+  printf ("appendbench: appended %d bytes in %d-byte writes\n",
+          written, chunk);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+/* dirbench.c
+
+   Measures directory operations on a large directory, in the
+   style of grow-dir-lg: creates N empty files (default 10000),
+   opens each of them, then removes them all.  Compare the tick
+   counts and disk statistics that Pintos prints at shutdown, e.g.
+
+        pintos --disk=16 -- -q -f run 'dirbench 10000'          */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[])
+{
+  char name[16];
+  int n, i;
+
+  if (argc > 2)
+    {
+      printf ("usage: dirbench [N]\n");
+      return EXIT_FAILURE;
+    }
+  n = argc == 2 ? atoi (argv[1]) : 10000;
+
+  for (i = 0; i < n; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        {
+          printf ("dirbench: create %s failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      fd = open (name);
+      if (fd < 0)
+        {
+          printf ("dirbench: open %s failed\n", name);
+          return EXIT_FAILURE;
+        }
+      close (fd);
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        {
+          printf ("dirbench: remove %s failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  printf ("dirbench: created, opened and removed %d files\n", n);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/* execbench.c
+
+   Measures the cost of starting and ending a process: runs
+   itself COUNT times as a child that exits at once, waiting for
+   each.  Compare the tick counts that Pintos prints at shutdown
+   across load policies, e.g.
+
+        pintos -- -q -load=lazy run 'execbench 200'
+        pintos -- -q -load=eager run 'execbench 200'      */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[])
+{
+  int count, i;
+
+  if (argc != 2)
+    {
+      printf ("usage: execbench COUNT\n");
+      return EXIT_FAILURE;
+    }
+
+  /* A child just exits. */
+  count = atoi (argv[1]);
+  if (count == 0)
+    return EXIT_SUCCESS;
+
+  for (i = 0; i < count; i++)
+    {
+      pid_t pid = exec ("execbench 0");
+      if (pid == PID_ERROR || wait (pid) != EXIT_SUCCESS)
+        {
+          printf ("execbench: child %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  printf ("execbench: %d exec and exit round trips\n", count);
+  return EXIT_SUCCESS;
+}
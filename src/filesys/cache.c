@@ -0,0 +1,381 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/** Number of sectors in the buffer cache. */
+size_t cache_sector_cnt = 64;
+
+/** Ticks between two write-behind passes of the flusher. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/** Sectors waiting to be read ahead.  Requests beyond this are
+   dropped: read-ahead is only a hint. */
+#define READ_AHEAD_MAX 16
+
+/** A sector of the file system device held in memory. */
+struct cache_entry
+  {
+    struct hash_elem elem;              /**< Element in cache_map. */
+    block_sector_t sector;              /**< Sector held, if valid. */
+    bool valid;                         /**< Holds a sector? */
+    bool dirty;                         /**< Differs from the disk? */
+    bool accessed;                      /**< Used since the clock passed? */
+    bool busy;                          /**< Being read or written? */
+    bool pinned;                        /**< Kept off the disk for now? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /**< Sector contents. */
+  };
+
+/** The cache entries, and the clock hand over them. */
+static struct cache_entry *cache;
+static size_t hand;
+
+/** Valid entries by sector. */
+static struct hash cache_map;
+
+/** Protects everything in the cache.  Entries are read from and
+   written to disk with it released and their BUSY flag set;
+   IO_DONE is signalled whenever such a transfer ends. */
+static struct lock cache_lock;
+static struct condition io_done;
+
+/** Ring of sectors to read ahead, and its condition. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct condition read_ahead_cond;
+
+/** Statistics. */
+static long long hit_cnt, miss_cnt, ahead_cnt;
+
+static thread_func flusher NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *ce = hash_entry (e, struct cache_entry, elem);
+  return hash_int (ce->sector);
+}
+
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, elem)->sector
+          < hash_entry (b, struct cache_entry, elem)->sector);
+}
+
+/** Initializes the buffer cache and starts its flusher and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  cache = malloc (cache_sector_cnt * sizeof *cache);
+  if (cache == NULL || !hash_init (&cache_map, entry_hash, entry_less, NULL))
+    PANIC ("buffer cache creation failed");
+  for (i = 0; i < cache_sector_cnt; i++)
+    {
+      cache[i].valid = false;
+      cache[i].dirty = false;
+      cache[i].accessed = false;
+      cache[i].busy = false;
+      cache[i].pinned = false;
+    }
+  hand = 0;
+
+  lock_init (&cache_lock);
+  cond_init (&io_done);
+  cond_init (&read_ahead_cond);
+
+  thread_create ("cache-flush", PRI_DEFAULT, flusher, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/** Returns the valid entry holding SECTOR, or a null pointer.
+   Must hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/** Writes dirty entry CE back to disk.  Must hold cache_lock,
+   which is released during the write. */
+static void
+write_back (struct cache_entry *ce)
+{
+  ASSERT (ce->valid && ce->dirty && !ce->busy);
+
+  ce->busy = true;
+  ce->dirty = false;
+  lock_release (&cache_lock);
+  block_write (fs_device, ce->sector, ce->data);
+  lock_acquire (&cache_lock);
+  ce->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+}
+
+/** Advances the clock hand to an entry that is neither busy nor
+   pinned and has not been used since the hand last passed, and
+   returns it.
+   Waits for a transfer to end if every entry is busy.  Must hold
+   cache_lock. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t scanned;
+
+  for (;;)
+    {
+      for (scanned = 0; scanned < 2 * cache_sector_cnt; scanned++)
+        {
+          struct cache_entry *ce = &cache[hand];
+          hand = (hand + 1) % cache_sector_cnt;
+          if (ce->busy || ce->pinned)
+            continue;
+          if (!ce->valid || !ce->accessed)
+            return ce;
+          ce->accessed = false;
+        }
+      cond_wait (&io_done, &cache_lock);
+    }
+}
+
+/** Returns the entry holding SECTOR, loading the sector from disk
+   into a free or evicted entry unless FILL is false, in which case
+   the caller overwrites the whole sector.  Must hold cache_lock,
+   which may be released while waiting for the disk. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool fill)
+{
+  for (;;)
+    {
+      struct cache_entry *ce = lookup (sector);
+      if (ce != NULL)
+        {
+          /* Wait while the sector is being loaded or written. */
+          if (ce->busy)
+            {
+              cond_wait (&io_done, &cache_lock);
+              continue;
+            }
+          ce->accessed = true;
+          return ce;
+        }
+
+      /* A victim that is dirty is written back first; someone may
+         have brought in SECTOR meanwhile, so look again. */
+      ce = pick_victim ();
+      if (ce->valid && ce->dirty)
+        {
+          write_back (ce);
+          continue;
+        }
+
+      if (ce->valid)
+        hash_delete (&cache_map, &ce->elem);
+      ce->sector = sector;
+      ce->valid = true;
+      ce->dirty = false;
+      ce->pinned = false;
+      ce->accessed = true;
+      hash_insert (&cache_map, &ce->elem);
+
+      if (fill)
+        {
+          ce->busy = true;
+          lock_release (&cache_lock);
+          block_read (fs_device, sector, ce->data);
+          lock_acquire (&cache_lock);
+          ce->busy = false;
+          cond_broadcast (&io_done, &cache_lock);
+        }
+      return ce;
+    }
+}
+
+/** Reads SIZE bytes at OFFSET within SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int offset, int size)
+{
+  struct cache_entry *ce;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) != NULL)
+    hit_cnt++;
+  else
+    miss_cnt++;
+  ce = get_entry (sector, true);
+  memcpy (buffer, ce->data + offset, size);
+  lock_release (&cache_lock);
+}
+
+/** Writes SIZE bytes from BUFFER at OFFSET within SECTOR, and
+   pins the sector if PIN is true. */
+static void
+write_at (block_sector_t sector, const void *buffer, int offset, int size,
+          bool pin)
+{
+  struct cache_entry *ce;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) != NULL)
+    hit_cnt++;
+  else
+    miss_cnt++;
+  ce = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (ce->data + offset, buffer, size);
+  ce->dirty = true;
+  if (pin)
+    ce->pinned = true;
+  lock_release (&cache_lock);
+}
+
+/** Writes SIZE bytes from BUFFER at OFFSET within SECTOR.  The
+   sector reaches the disk later, when it is evicted or flushed. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int offset, int size)
+{
+  write_at (sector, buffer, offset, size, false);
+}
+
+/** Like cache_write_at(), but also pins SECTOR: it is neither
+   evicted nor written back until cache_unpin() is called for it,
+   so that the disk never sees a change before the journal holds
+   it. */
+void
+cache_write_pinned_at (block_sector_t sector, const void *buffer,
+                       int offset, int size)
+{
+  write_at (sector, buffer, offset, size, true);
+}
+
+/** Lets SECTOR, pinned by cache_write_pinned_at(), be written
+   back again. */
+void
+cache_unpin (block_sector_t sector)
+{
+  struct cache_entry *ce;
+
+  lock_acquire (&cache_lock);
+  ce = lookup (sector);
+  if (ce != NULL)
+    ce->pinned = false;
+  lock_release (&cache_lock);
+}
+
+/** Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/** Writes SECTOR from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/** Asks for SECTOR to be loaded in the background, because it is
+   likely to be read soon. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  if (sector >= block_size (fs_device))
+    return;
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) == NULL && read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++) % READ_AHEAD_MAX]
+        = sector;
+      cond_signal (&read_ahead_cond, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/** Loads the sectors asked for by cache_read_ahead(). */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      block_sector_t sector;
+
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+
+      if (lookup (sector) == NULL)
+        {
+          struct cache_entry *ce = get_entry (sector, true);
+
+          /* Not used yet: the first to go if it never is. */
+          ce->accessed = false;
+          ahead_cnt++;
+        }
+    }
+}
+
+/** Writes every dirty sector that is not pinned back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_sector_cnt; i++)
+    {
+      while (cache[i].busy)
+        cond_wait (&io_done, &cache_lock);
+      if (cache[i].valid && cache[i].dirty && !cache[i].pinned)
+        write_back (&cache[i]);
+    }
+  lock_release (&cache_lock);
+}
+
+/** Writes dirty sectors behind, every FLUSH_INTERVAL ticks, so
+   that little is lost if the machine stops without shutting
+   down. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/** Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %lld hits, %lld misses, %lld sectors read ahead\n",
+          hit_cnt, miss_cnt, ahead_cnt);
+}
@@ -0,0 +1,22 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/** Number of sectors in the buffer cache ("-bc=N"). */
+extern size_t cache_sector_cnt;
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_read_at (block_sector_t, void *, int offset, int size);
+void cache_write_at (block_sector_t, const void *, int offset, int size);
+void cache_write_pinned_at (block_sector_t, const void *,
+                            int offset, int size);
+void cache_unpin (block_sector_t);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /**< filesys/cache.h */
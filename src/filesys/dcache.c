@@ -0,0 +1,155 @@
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/** Most names the cache holds.  Past this, the least recently
+   used ones are dropped. */
+#define DCACHE_MAX 256
+
+/** What a directory holds under a name: the sector of the file's
+   inode, or DCACHE_ABSENT if it holds nothing. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /**< Element in dentries. */
+    struct list_elem lru_elem;          /**< Element in lru. */
+    block_sector_t dir;                 /**< Directory's inode sector. */
+    char name[NAME_MAX + 1];            /**< Name in the directory. */
+    block_sector_t sector;              /**< Inode sector, or absent. */
+  };
+
+/** Cached names by directory and name, and from the least to the
+   most recently used. */
+static struct hash dentries;
+static struct list lru;
+static struct lock dcache_lock;
+
+/** Statistics. */
+static long long hit_cnt, negative_hit_cnt, miss_cnt;
+
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_int (d->dir) ^ hash_string (d->name);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/** Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("dentry cache creation failed");
+  list_init (&lru);
+  lock_init (&dcache_lock);
+}
+
+/** Returns the cached entry for NAME in directory DIR, or a null
+   pointer.  Must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/** Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows about it, returns true and stores in
+   *SECTORP the sector of its inode, or DCACHE_ABSENT if the
+   directory holds no such name.  Returns false if the directory
+   has to be searched. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_back (&lru, &d->lru_elem);
+      *sectorp = d->sector;
+      if (d->sector != DCACHE_ABSENT)
+        hit_cnt++;
+      else
+        negative_hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/** Records that the directory whose inode is in sector DIR holds
+   the inode in SECTOR under NAME, or no file at all if SECTOR is
+   DCACHE_ABSENT.  Directories call this whenever they learn or
+   change what a name stands for, so that the cache stays exact. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      /* Reuse the least recently used entry if the cache is full. */
+      if (hash_size (&dentries) >= DCACHE_MAX)
+        {
+          d = list_entry (list_pop_front (&lru), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      else
+        d = malloc (sizeof *d);
+      if (d != NULL)
+        {
+          d->dir = dir;
+          strlcpy (d->name, name, sizeof d->name);
+          hash_insert (&dentries, &d->hash_elem);
+        }
+    }
+
+  if (d != NULL)
+    {
+      d->sector = sector;
+      list_push_back (&lru, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/** Prints dentry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses\n",
+          hit_cnt, negative_hit_cnt, miss_cnt);
+}
@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /** A directory. */
 struct dir 
@@ -18,15 +21,111 @@ struct dir_entry
   {
     block_sector_t inode_sector;        /**< Sector number of header. */
     char name[NAME_MAX + 1];            /**< Null terminated file name. */
-    bool in_use;                        /**< In use or free? */
   };
 
+/** A directory is a B+tree of entries, keyed by the hash of their
+   names, in which each node is one sector-sized block of the
+   directory file.  Block 0 is always the root.  A directory
+   starts out as a single leaf, which is scanned like a plain
+   table; once it fills up, it splits, and the root becomes an
+   interior node.  Entries with the same hash always share a leaf,
+   so the separators are strict. */
+#define NODE_SIZE BLOCK_SECTOR_SIZE
+#define NODE_HEADER 8
+#define LEAF_CNT ((NODE_SIZE - NODE_HEADER) / sizeof (struct dir_entry))
+#define INTERIOR_CNT ((NODE_SIZE - NODE_HEADER) / sizeof (struct dir_key))
+
+/** Key of an interior node: the first hash under CHILD.  The
+   first key's hash is not used. */
+struct dir_key
+  {
+    uint32_t hash;                      /**< Least hash in CHILD. */
+    uint32_t child;                     /**< Block of the child. */
+  };
+
+/** A node of a directory's tree. */
+struct dir_node
+  {
+    uint16_t is_leaf;                   /**< Leaf or interior node? */
+    uint16_t cnt;                       /**< Entries or keys in use. */
+    uint32_t unused;                    /**< Not used. */
+    union
+      {
+        struct dir_entry entries[LEAF_CNT];     /**< Sorted by hash. */
+        struct dir_key keys[INTERIOR_CNT];      /**< Sorted by hash. */
+      };
+  };
+
+/** A node that split in two: the least hash in the new node, and
+   its block, or 0 if the node did not split. */
+struct split
+  {
+    uint32_t hash;
+    uint32_t block;
+  };
+
+static inline uint32_t
+name_hash (const char *name)
+{
+  return hash_string (name);
+}
+
+/** Reads node BLOCK of INODE into NODE. */
+static bool
+read_node (struct inode *inode, uint32_t block, struct dir_node *node)
+{
+  return inode_read_at (inode, node, NODE_SIZE, block * NODE_SIZE) == NODE_SIZE;
+}
+
+/** Writes NODE as node BLOCK of INODE. */
+static bool
+write_node (struct inode *inode, uint32_t block, const struct dir_node *node)
+{
+  return inode_write_at (inode, node, NODE_SIZE, block * NODE_SIZE) == NODE_SIZE;
+}
+
+/** Returns the index of the child of interior NODE under which
+   HASH belongs. */
+static size_t
+find_child (const struct dir_node *node, uint32_t hash)
+{
+  size_t lo = 0, hi = node->cnt;
+
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (node->keys[mid].hash <= hash)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
 /** Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Returns true if successful, false on failure.
+   The directory starts out as an empty leaf and grows as entries
+   are added, so ENTRY_CNT is only a hint. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt UNUSED)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct inode *inode;
+  struct dir_node *root;
+  bool success = false;
+
+  if (!inode_create (sector, 0))
+    return false;
+  inode = inode_open (sector);
+  root = calloc (1, sizeof *root);
+  if (inode != NULL && root != NULL)
+    {
+      inode_set_metadata (inode);
+      root->is_leaf = true;
+      success = write_node (inode, 0, root);
+    }
+  free (root);
+  inode_close (inode);
+  return success;
 }
 
 /** Opens and returns the directory for the given INODE, of which
@@ -37,6 +136,7 @@ dir_open (struct inode *inode)
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
     {
+      inode_set_metadata (inode);
       dir->inode = inode;
       dir->pos = 0;
       return dir;
@@ -84,28 +184,36 @@ dir_get_inode (struct dir *dir)
 }
 
 /** Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   If successful, returns true, reads the leaf holding the entry
+   into NODE and stores its block in *BLOCKP and its index in
+   *IDXP.  Otherwise, returns false.  NODE is scratch space in
+   either case. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_node *node, uint32_t *blockp, size_t *idxp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  uint32_t hash = name_hash (name);
+  uint32_t block = 0;
+  size_t i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  for (;;)
+    {
+      if (!read_node (dir->inode, block, node))
+        return false;
+      if (node->is_leaf)
+        break;
+      block = node->keys[find_child (node, hash)].child;
+    }
+
+  for (i = 0; i < node->cnt; i++)
+    if (name_hash (node->entries[i].name) == hash
+        && !strcmp (name, node->entries[i].name)) 
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
+        *blockp = block;
+        *idxp = i;
         return true;
       }
   return false;
@@ -119,19 +227,187 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t dir_sector, sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  /* Search the tree only if the dentry cache does not know the
+     name, and tell it what the search found. */
+  *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      struct dir_node *node = malloc (sizeof *node);
+      uint32_t block;
+      size_t idx;
+
+      if (node == NULL)
+        goto done;
+      if (lookup (dir, name, node, &block, &idx))
+        sector = node->entries[idx].inode_sector;
+      else
+        sector = DCACHE_ABSENT;
+      free (node);
+      dcache_insert (dir_sector, name, sector);
+    }
+  if (sector != DCACHE_ABSENT)
+    *inode = inode_open (sector);
 
+ done:
+  rwlock_release_read (inode_dir_lock (dir->inode));
   return *inode != NULL;
 }
 
+/** Splits full leaf NODE, into which entry E must go at index
+   POS, into NODE and a new leaf at the end of INODE, and stores
+   the new leaf's least hash and block in *SPLIT.  Entries with the
+   same hash stay together, so the split falls on the change of
+   hash closest to the middle. */
+static bool
+split_leaf (struct inode *inode, struct dir_node *node, size_t pos,
+            const struct dir_entry *e, struct split *split)
+{
+  struct dir_entry *all = malloc ((LEAF_CNT + 1) * sizeof *all);
+  struct dir_node *right = calloc (1, sizeof *right);
+  size_t cnt = LEAF_CNT + 1, m = cnt, i;
+  bool success = false;
+
+  if (all == NULL || right == NULL)
+    goto done;
+  memcpy (all, node->entries, pos * sizeof *all);
+  all[pos] = *e;
+  memcpy (all + pos + 1, node->entries + pos, (LEAF_CNT - pos) * sizeof *all);
+
+  for (i = 0; i < cnt / 2; i++)
+    {
+      if (name_hash (all[cnt / 2 - i - 1].name) != name_hash (all[cnt / 2 - i].name))
+        {
+          m = cnt / 2 - i;
+          break;
+        }
+      if (cnt / 2 + i + 1 < cnt
+          && name_hash (all[cnt / 2 + i].name) != name_hash (all[cnt / 2 + i + 1].name))
+        {
+          m = cnt / 2 + i + 1;
+          break;
+        }
+    }
+  if (m == cnt)
+    goto done;
+
+  node->cnt = m;
+  memcpy (node->entries, all, m * sizeof *all);
+  right->is_leaf = true;
+  right->cnt = cnt - m;
+  memcpy (right->entries, all + m, (cnt - m) * sizeof *all);
+  split->hash = name_hash (all[m].name);
+  split->block = inode_length (inode) / NODE_SIZE;
+  success = write_node (inode, split->block, right);
+
+ done:
+  free (all);
+  free (right);
+  return success;
+}
+
+/** Splits full interior NODE, into which KEY must go at index POS,
+   like split_leaf(). */
+static bool
+split_interior (struct inode *inode, struct dir_node *node, size_t pos,
+                const struct dir_key *key, struct split *split)
+{
+  struct dir_key *all = malloc ((INTERIOR_CNT + 1) * sizeof *all);
+  struct dir_node *right = calloc (1, sizeof *right);
+  size_t cnt = INTERIOR_CNT + 1, m = cnt / 2;
+  bool success = false;
+
+  if (all != NULL && right != NULL)
+    {
+      memcpy (all, node->keys, pos * sizeof *all);
+      all[pos] = *key;
+      memcpy (all + pos + 1, node->keys + pos,
+              (INTERIOR_CNT - pos) * sizeof *all);
+
+      node->cnt = m;
+      memcpy (node->keys, all, m * sizeof *all);
+      right->is_leaf = false;
+      right->cnt = cnt - m;
+      memcpy (right->keys, all + m, (cnt - m) * sizeof *all);
+      split->hash = all[m].hash;
+      split->block = inode_length (inode) / NODE_SIZE;
+      success = write_node (inode, split->block, right);
+    }
+  free (all);
+  free (right);
+  return success;
+}
+
+/** Inserts entry E, whose name hashes to HASH, into the subtree
+   of INODE rooted at BLOCK, and reports in *SPLIT whether the
+   subtree's root split.  NODE is scratch space. */
+static bool
+insert (struct inode *inode, uint32_t block, const struct dir_entry *e,
+        uint32_t hash, struct dir_node *node, struct split *split)
+{
+  size_t pos;
+
+  split->block = 0;
+  if (!read_node (inode, block, node))
+    return false;
+
+  if (node->is_leaf)
+    {
+      for (pos = 0; pos < node->cnt; pos++)
+        if (name_hash (node->entries[pos].name) > hash)
+          break;
+      if (node->cnt == LEAF_CNT)
+        {
+          if (!split_leaf (inode, node, pos, e, split))
+            return false;
+        }
+      else
+        {
+          memmove (node->entries + pos + 1, node->entries + pos,
+                   (node->cnt - pos) * sizeof *node->entries);
+          node->entries[pos] = *e;
+          node->cnt++;
+        }
+    }
+  else
+    {
+      struct split child;
+      struct dir_key key;
+
+      pos = find_child (node, hash);
+      if (!insert (inode, node->keys[pos].child, e, hash, node, &child))
+        return false;
+      if (child.block == 0)
+        return true;
+
+      /* The child split: add a key for its new sibling. */
+      if (!read_node (inode, block, node))
+        return false;
+      key.hash = child.hash;
+      key.child = child.block;
+      pos++;
+      if (node->cnt == INTERIOR_CNT)
+        {
+          if (!split_interior (inode, node, pos, &key, split))
+            return false;
+        }
+      else
+        {
+          memmove (node->keys + pos + 1, node->keys + pos,
+                   (node->cnt - pos) * sizeof *node->keys);
+          node->keys[pos] = key;
+          node->cnt++;
+        }
+    }
+  return write_node (inode, block, node);
+}
+
 /** Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -142,7 +418,11 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
+  struct dir_node *node;
+  struct split split;
+  block_sector_t dir_sector, sector;
+  uint32_t block;
+  size_t idx;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -152,85 +432,135 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  node = malloc (sizeof *node);
+  if (node == NULL)
+    return false;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  dir_sector = inode_get_inumber (dir->inode);
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  if (dcache_lookup (dir_sector, name, &sector)
+      ? sector != DCACHE_ABSENT
+      : lookup (dir, name, node, &block, &idx))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
+  /* Insert the entry. */
+  memset (&e, 0, sizeof e);
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (!insert (dir->inode, 0, &e, name_hash (name), node, &split))
+    goto done;
+
+  /* The root split: move what is left of it to a new block, so
+     that the root stays in block 0, and make it the parent of
+     both halves. */
+  if (split.block != 0)
+    {
+      uint32_t left = inode_length (dir->inode) / NODE_SIZE;
+
+      if (!read_node (dir->inode, 0, node)
+          || !write_node (dir->inode, left, node))
+        goto done;
+      memset (node, 0, sizeof *node);
+      node->is_leaf = false;
+      node->cnt = 2;
+      node->keys[0].child = left;
+      node->keys[1].hash = split.hash;
+      node->keys[1].child = split.block;
+      if (!write_node (dir->inode, 0, node))
+        goto done;
+    }
+  dcache_insert (dir_sector, name, inode_sector);
+  success = true;
 
  done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
+  free (node);
   return success;
 }
 
 /** Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME.
+   Leaves are not merged when they empty out. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  struct dir_node *node;
   struct inode *inode = NULL;
   bool success = false;
-  off_t ofs;
+  uint32_t block;
+  size_t idx;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  node = malloc (sizeof *node);
+  if (node == NULL)
+    return false;
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  if (!lookup (dir, name, node, &block, &idx))
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (node->entries[idx].inode_sector);
   if (inode == NULL)
     goto done;
 
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  node->cnt--;
+  memmove (node->entries + idx, node->entries + idx + 1,
+           (node->cnt - idx) * sizeof *node->entries);
+  if (!write_node (dir->inode, block, node))
     goto done;
 
   /* Remove inode. */
   inode_remove (inode);
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_ABSENT);
   success = true;
 
  done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
   inode_close (inode);
+  free (node);
   return success;
 }
 
 /** Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Entries come in the order of the
+   blocks of the directory, not of their names. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_node header;
   struct dir_entry e;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
+  while (dir->pos < inode_length (dir->inode)) 
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      off_t block_ofs = dir->pos / NODE_SIZE * NODE_SIZE;
+      size_t idx = 0;
+
+      if (dir->pos - block_ofs > NODE_HEADER)
+        idx = (dir->pos - block_ofs - NODE_HEADER) / sizeof e;
+      if (inode_read_at (dir->inode, &header, NODE_HEADER, block_ofs)
+          != NODE_HEADER)
+        break;
+      if (header.is_leaf && idx < header.cnt)
         {
+          off_t ofs = block_ofs + NODE_HEADER + idx * sizeof e;
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            break;
+          dir->pos = ofs + sizeof e;
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
+      dir->pos = block_ofs + NODE_SIZE;
     }
-  return false;
+  rwlock_release_read (inode_dir_lock (dir->inode));
+  return success;
 }
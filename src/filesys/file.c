@@ -41,6 +41,22 @@ file_reopen (struct file *file)
   return file_open (inode_reopen (file->inode));
 }
 
+/** Opens and returns a new file for the same inode as FILE,
+   at the same position and with the same write denial.
+   Returns a null pointer if unsuccessful. */
+struct file *
+file_duplicate (struct file *file) 
+{
+  struct file *nfile = file_open (inode_reopen (file->inode));
+  if (nfile != NULL)
+    {
+      nfile->pos = file->pos;
+      if (file->deny_write)
+        file_deny_write (nfile);
+    }
+  return nfile;
+}
+
 /** Closes FILE. */
 void
 file_close (struct file *file) 
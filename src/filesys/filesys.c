@@ -2,19 +2,31 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
-#include "threads/synch.h"
 
 /** Partition that contains the file system. */
 struct block *fs_device;
 
-static struct lock filesys_lock;
-
 static void do_format (void);
 
+/** Journal credits for creating a file: its inode, the free map
+   sector of its bit, the directory nodes that adding its entry
+   rewrites, one per level of a tree up to five levels deep, and a
+   revoke of the inode if that fails.  Putting the nodes it appends
+   on disk takes credits of its own. */
+#define CREATE_CREDITS 8
+
+/** Journal credits for removing a file: the directory leaf its
+   entry is erased from.  Its sectors are freed later, in
+   transactions of their own. */
+#define REMOVE_CREDITS 1
+
 /** Initializes the file system module.
    If FORMAT is true, reformats the file system. */
 void
@@ -24,15 +36,17 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
+  /* Replays the journal before anything is read from the disk. */
+  journal_init (format);
   free_map_open ();
-  
-  lock_init(&filesys_lock);
 }
 
 /** Shuts down the file system module, writing any unwritten data
@@ -40,9 +54,10 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-  lock_acquire(&filesys_lock);
+  inode_flush_all ();
   free_map_close ();
-  lock_release(&filesys_lock);
+  journal_sync ();
+  cache_flush ();
 }
 
 /** Creates a file named NAME with the given INITIAL_SIZE.
@@ -52,17 +67,20 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  lock_acquire(&filesys_lock);
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  journal_begin (CREATE_CREDITS);
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
-  lock_release(&filesys_lock);
+  journal_end ();
 
   return success;
 }
@@ -75,7 +93,6 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  lock_acquire(&filesys_lock);
 
   struct dir *dir = dir_open_root ();
   struct inode *inode = NULL;
@@ -84,7 +101,6 @@ filesys_open (const char *name)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
 
-  lock_release(&filesys_lock);
 
   return file_open (inode);
 }
@@ -96,11 +112,20 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  lock_acquire(&filesys_lock);
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  struct inode *inode = NULL;
+  bool success;
+
+  /* The file is held open until the handle ends, so that its last
+     close, which frees its sectors, is not nested in the handle. */
+  journal_begin (REMOVE_CREDITS);
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && dir_lookup (dir, name, &inode)
+             && dir_remove (dir, name));
   dir_close (dir); 
-  lock_release(&filesys_lock);
+  journal_end ();
+  inode_close (inode);
 
   return success;
 }
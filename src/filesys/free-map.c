@@ -4,49 +4,161 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /**< Free map file. */
 static struct bitmap *free_map;      /**< Free map, one bit per sector. */
+static size_t free_cnt;              /**< Sectors free in the free map. */
+static size_t reserved_cnt;          /**< Free sectors promised to writes. */
+static block_sector_t free_hint;     /**< Every sector below is in use. */
+static struct lock free_map_lock;    /**< Protects the free map. */
+
+/** Number of sectors whose bits one sector of the free map file
+   holds. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/** Free sectors held back for the nodes of extent trees, so that
+   putting sectors that writes reserved on disk does not fail for
+   want of a node to map them once the disk is full. */
+#define NODE_RESERVE 64
 
 /** Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
-/** Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
-bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+/** Writes the sectors of the free map file that hold the bits of
+   sectors START...START+CNT-1, rather than the whole file, so that
+   the cost of a change does not grow with the disk.  The buffer
+   cache writes them back later. */
+static bool
+write_bits (block_sector_t start, size_t cnt)
+{
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+
+  return bitmap_write_range (free_map, free_map_file,
+                             first * BLOCK_SECTOR_SIZE,
+                             (last - first + 1) * BLOCK_SECTOR_SIZE);
+}
+
+/** Allocates CNT consecutive sectors and stores the first into
+   *SECTORP, taking them from the sectors reserved by
+   free_map_reserve() if RESERVED is true, or else from those that
+   are not reserved, leaving KEEP of those free. */
+static bool
+allocate (size_t cnt, block_sector_t *sectorp, bool reserved, size_t keep)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  if (reserved ? reserved_cnt < cnt : free_cnt - reserved_cnt < cnt + keep)
+    goto done;
+  sector = bitmap_scan_and_flip (free_map, free_hint, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+      && !write_bits (sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      free_cnt -= cnt;
+      if (sector == free_hint)
+        free_hint += cnt;
+      if (reserved)
+        reserved_cnt -= cnt;
+      *sectorp = sector;
+    }
+
+ done:
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/** Makes CNT sectors starting at SECTOR available for use. */
+/** Allocates CNT consecutive sectors from the free map and stores
+   the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate (size_t cnt, block_sector_t *sectorp)
+{
+  return allocate (cnt, sectorp, false, NODE_RESERVE);
+}
+
+/** Like free_map_allocate(), but takes the sectors from those
+   reserved with free_map_reserve(). */
+bool
+free_map_allocate_reserved (size_t cnt, block_sector_t *sectorp)
+{
+  return allocate (cnt, sectorp, true, 0);
+}
+
+/** Allocates a sector for a node of an inode's extent tree and
+   stores it into *SECTORP.  Unlike free_map_allocate(), this may
+   take the last free sectors that are not reserved. */
+bool
+free_map_allocate_node (block_sector_t *sectorp)
+{
+  return allocate (1, sectorp, false, 0);
+}
+
+/** Sets aside CNT free sectors, without choosing them yet, so that
+   later free_map_allocate_reserved() calls for as many sectors
+   cannot run out of space, only of consecutive space.
+   Returns false if fewer than CNT sectors are free, besides those
+   held back for extent tree nodes. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt + NODE_RESERVE;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/** Returns CNT sectors set aside by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/** Makes CNT sectors starting at SECTOR available for use.
+   Revokes what the journal logged for them, which takes a credit
+   of the current journal handle for each sector that was
+   metadata. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  journal_revoke (sector, cnt);
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  free_cnt += cnt;
+  if (sector < free_hint)
+    free_hint = sector;
+  write_bits (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
 /** Opens the free map file and reads it from disk. */
@@ -56,8 +168,10 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_metadata (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
 }
 
 /** Writes the free map to disk and closes the free map file. */
@@ -72,14 +186,23 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file starts out as a hole: its own
+     sectors are allocated when it is first flushed, which must
+     happen before it becomes free_map_file, as writing their bits
+     to it needs them on disk already.  Then the bitmap is written
+     again with those bits set. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file) || !inode_flush (file_get_inode (file)))
+    PANIC ("can't write free map");
+  free_map_file = file;
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
@@ -1,23 +1,86 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /** Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/** Number of extents held in an inode. */
+#define INODE_EXTENTS 40
+
+/** Number of entries held in a node sector. */
+#define NODE_EXTENTS 42
+
+/** Most levels of nodes below an inode.  An inode then maps
+   INODE_EXTENTS * NODE_EXTENTS**DEPTH_MAX extents, far more than a
+   disk has sectors. */
+#define DEPTH_MAX 4
+
+/** Delayed sectors an inode holds in memory before it gives them
+   disk sectors. */
+#define DELAY_MAX 64
+
+/** Holes this many sectors long or shorter, next to sectors being
+   put on disk, are filled with zeros rather than left, so that
+   writes scattered over a sparse file do not split its extents
+   without end.  Not done for metadata, whose sectors all go
+   through the journal. */
+#define ZEROOUT_SECTORS 8
+
+/** Most delayed sectors of a metadata inode put on disk at once,
+   so that doing it fits in one journal handle. */
+#define METADATA_RUN 8
+
+/** Most sectors freed at once when a removed inode is closed.
+   Their bits span at most two sectors of the free map. */
+#define RELEASE_RUN (BLOCK_SECTOR_SIZE * 8)
+
+/** Sectors read ahead from the extent a sequential reader is in. */
+#define READ_AHEAD_SECTORS 8
+
+/** A run of COUNT sectors of a file, from file sector LOGICAL on,
+   stored in consecutive disk sectors from START on. */
+struct extent
+  {
+    uint32_t logical;                   /**< First file sector. */
+    block_sector_t start;               /**< First disk sector. */
+    uint32_t count;                     /**< Number of sectors. */
+  };
+
+/** Start of an extent of file sectors that were never written.
+   They read as zeros and have no disk sectors.  Sector 0 holds the
+   free map inode, so it is never file data. */
+#define HOLE 0
+
 /** On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   The first ALLOCATED sectors of the file are mapped by extents
+   sorted by file sector, with no gaps between them.  At DEPTH 0,
+   EXTENTS holds them.  Otherwise they are held by the leaves of a
+   tree DEPTH levels of node sectors deep: each of EXTENTS, and
+   each entry of a node above the leaves, describes a node of the
+   level below instead, with LOGICAL the first file sector it maps,
+   START the node sector, and COUNT the number of entries in it.
+   The sectors of extents that start at HOLE, and those past
+   ALLOCATED, were never written and read as zeros. */
 struct inode_disk
   {
-    block_sector_t start;               /**< First data sector. */
     off_t length;                       /**< File size in bytes. */
     unsigned magic;                     /**< Magic number. */
-    uint32_t unused[125];               /**< Not used. */
+    uint32_t allocated;                 /**< File sectors mapped. */
+    uint16_t depth;                     /**< Levels of nodes, see above. */
+    uint16_t extent_cnt;                /**< Entries used in EXTENTS. */
+    struct extent extents[INODE_EXTENTS];
+    uint32_t unused[4];                 /**< Not used. */
   };
 
 /** Returns the number of sectors to allocate for an inode SIZE
@@ -28,47 +91,843 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/** A file sector written where the file has no disk sector yet,
+   in a hole or past the sectors mapped.  A free sector is reserved
+   for it in the free map, but its disk sector is only chosen when
+   the inode's delayed sectors are flushed, all at once, so that
+   they end up in long runs. */
+struct delayed_sector
+  {
+    struct list_elem elem;              /**< Element in inode's list. */
+    uint32_t idx;                       /**< File sector. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /**< Contents. */
+  };
+
 /** In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /**< Element in inode list. */
+    struct hash_elem elem;              /**< Element in open_inodes. */
     block_sector_t sector;              /**< Sector number of disk location. */
     int open_cnt;                       /**< Number of openers. */
+    bool loading;                       /**< DATA not read in yet? */
+    bool closing;                       /**< Last closer finishing up? */
+    bool reopened;                      /**< Opened again while closing? */
     bool removed;                       /**< True if deleted, false otherwise. */
+    bool metadata;                      /**< Data is file system metadata? */
+    struct list_elem flush_elem;        /**< Element in inode_flush_all(). */
     int deny_write_cnt;                 /**< 0: writes ok, >0: deny writes. */
+    struct rwlock dir_lock;             /**< Guards a directory's entries. */
+    struct rwlock lock;                 /**< Protects the fields below. */
+    struct list delayed;                /**< Delayed sectors, by file sector. */
+    size_t delayed_cnt;                 /**< Number of delayed sectors. */
+    bool dirty;                         /**< DATA differs from the disk? */
     struct inode_disk data;             /**< Inode content. */
   };
 
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/** Reads entry I of node sector NODE into *E. */
+static void
+read_extent (block_sector_t node, size_t i, struct extent *e)
+{
+  cache_read_at (node, e, i * sizeof *e, sizeof *e);
+}
+
+/** Writes the CNT entries of EXTENTS to node sector NODE, which
+   is new if FRESH is true. */
+static void
+write_node (block_sector_t node, const struct extent *extents, size_t cnt,
+            bool fresh)
+{
+  if (fresh)
+    journal_write (node, zeros);
+  journal_write_at (node, extents, 0, cnt * sizeof *extents);
+}
+
+/** Returns the index of the last of the CNT extents in EXTENTS,
+   sorted by file sector, that starts at or before file sector
+   IDX. */
+static size_t
+search (const struct extent *extents, size_t cnt, uint32_t idx)
+{
+  size_t lo = 0, hi = cnt;
+
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (extents[mid].logical <= idx)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/** Returns the index of the last of the CNT entries of node sector
+   NODE that starts at or before file sector IDX. */
+static size_t
+search_node (block_sector_t node, size_t cnt, uint32_t idx)
+{
+  size_t lo = 0, hi = cnt;
+
+  while (hi - lo > 1)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      struct extent e;
+
+      read_extent (node, mid, &e);
+      if (e.logical <= idx)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/** Stores in *E the extent of DISK_INODE that maps file sector
+   IDX, which must be mapped, in O(log extents) time. */
+static void
+find_extent (const struct inode_disk *disk_inode, uint32_t idx,
+             struct extent *e)
+{
+  unsigned level;
+
+  ASSERT (idx < disk_inode->allocated);
+
+  *e = disk_inode->extents[search (disk_inode->extents,
+                                   disk_inode->extent_cnt, idx)];
+  for (level = 0; level < disk_inode->depth; level++)
+    read_extent (e->start, search_node (e->start, e->count, idx), e);
+  ASSERT (idx - e->logical < e->count);
+}
+
+/** Returns the disk sector holding file sector IDX of DISK_INODE,
+   which must be mapped, or HOLE if it was never written.  If RUN
+   is not null, stores in *RUN how many sectors of the file, from
+   IDX on, follow it on disk without a break, or are in the same
+   hole. */
+static block_sector_t
+lookup (const struct inode_disk *disk_inode, uint32_t idx, uint32_t *run)
+{
+  struct extent e;
+
+  find_extent (disk_inode, idx, &e);
+  if (run != NULL)
+    *run = e.count - (idx - e.logical);
+  return e.start != HOLE ? e.start + (idx - e.logical) : HOLE;
+}
+
+/** Returns true if extent B continues extent A, both in the file
+   and on disk, or as a hole. */
+static bool
+continues (const struct extent *a, const struct extent *b)
+{
+  if (a->logical + a->count != b->logical)
+    return false;
+  if (a->start == HOLE)
+    return b->start == HOLE;
+  return a->start + a->count == b->start;
+}
+
+/** Stores in OUT the CNT entries of EXTENTS with entry P replaced
+   by the N entries of NEW, and returns how many OUT holds.  If
+   MERGE is true, the entries are extents, and those that continue
+   each other are merged.  OUT must have room for CNT + N - 1
+   entries. */
+static size_t
+splice (const struct extent *extents, size_t cnt, size_t p,
+        const struct extent *new, size_t n, struct extent *out, bool merge)
+{
+  size_t i, j = 0;
+
+  for (i = 0; i < cnt + n - 1; i++)
+    {
+      const struct extent *e = (i < p ? &extents[i]
+                                : i < p + n ? &new[i - p]
+                                : &extents[i - n + 1]);
+      if (merge && j > 0 && continues (&out[j - 1], e))
+        out[j - 1].count += e->count;
+      else
+        out[j++] = *e;
+    }
+  return j;
+}
+
+/** A level of the extent tree on the way from an inode down to
+   the leaf that maps a file sector. */
+struct tree_level
+  {
+    block_sector_t node;                /**< Node sector, unless the inode. */
+    size_t cnt;                         /**< Entries in the node. */
+    size_t pos;                         /**< Entry on the way down. */
+  };
+
+/** Replaces the extent of DISK_INODE that maps file sector IDX
+   with the N extents, at most 3, of NEW, which take its place in
+   file order, merging the extents that continue each other.  A
+   node that overflows is split in two, which adds an entry to the
+   level above it; when the inode overflows, its entries move to a
+   new node and the tree grows a level deeper.  The node sectors
+   this takes are allocated first, so that the tree is left as it
+   was if they cannot be.  Returns false if memory or a node sector
+   cannot be allocated, or the tree is as deep as it can be. */
+static bool
+replace_extent (struct inode_disk *disk_inode, uint32_t idx,
+                const struct extent *new, size_t n)
+{
+  struct tree_level path[DEPTH_MAX + 1];
+  block_sector_t spare[DEPTH_MAX + 1];
+  size_t spare_cnt = 0, needed = 0, size, out_cnt;
+  unsigned depth = disk_inode->depth, level;
+  struct extent *buf, *out, carry[2];
+  bool split;
+
+  ASSERT (n >= 1 && n <= 3);
+
+  /* A node, and a node with up to two entries more. */
+  buf = malloc ((2 * NODE_EXTENTS + 2) * sizeof *buf);
+  if (buf == NULL)
+    return false;
+  out = buf + NODE_EXTENTS;
+
+  /* Find the way down to the leaf. */
+  path[0].cnt = disk_inode->extent_cnt;
+  path[0].pos = search (disk_inode->extents, path[0].cnt, idx);
+  carry[0] = disk_inode->extents[path[0].pos];
+  for (level = 1; level <= depth; level++)
+    {
+      path[level].node = carry[0].start;
+      path[level].cnt = carry[0].count;
+      path[level].pos = search_node (carry[0].start, carry[0].count, idx);
+      read_extent (carry[0].start, path[level].pos, &carry[0]);
+    }
+
+  /* Splice the leaf, and count the nodes the splits up from it
+     take. */
+  if (depth == 0)
+    out_cnt = splice (disk_inode->extents, path[0].cnt, path[0].pos,
+                      new, n, out, true);
+  else
+    {
+      cache_read_at (path[depth].node, buf, 0, path[depth].cnt * sizeof *buf);
+      out_cnt = splice (buf, path[depth].cnt, path[depth].pos, new, n, out,
+                        true);
+    }
+  size = out_cnt;
+  for (level = depth; ; level--)
+    {
+      split = size > (level > 0 ? NODE_EXTENTS : INODE_EXTENTS);
+      if (!split)
+        break;
+      needed++;
+      if (level == 0)
+        break;
+      size = path[level - 1].cnt + 1;
+    }
+  if (split && depth == DEPTH_MAX)
+    {
+      free (buf);
+      return false;
+    }
+  for (; spare_cnt < needed; spare_cnt++)
+    if (!free_map_allocate_node (&spare[spare_cnt]))
+      {
+        while (spare_cnt-- > 0)
+          free_map_release (spare[spare_cnt], 1);
+        free (buf);
+        return false;
+      }
+
+  /* Write the levels from the leaf up, for as long as the entry
+     for the level below changes. */
+  for (level = depth; ; level--)
+    {
+      if (level < depth)
+        {
+          /* Replace the entry for the level below with CARRY. */
+          if (level == 0)
+            out_cnt = splice (disk_inode->extents, path[0].cnt, path[0].pos,
+                              carry, n, out, false);
+          else
+            {
+              cache_read_at (path[level].node, buf, 0,
+                             path[level].cnt * sizeof *buf);
+              out_cnt = splice (buf, path[level].cnt, path[level].pos,
+                                carry, n, out, false);
+            }
+        }
+
+      if (level == 0)
+        {
+          if (out_cnt > INODE_EXTENTS)
+            {
+              /* Move the inode's entries down to a new node. */
+              block_sector_t node = spare[--spare_cnt];
+
+              write_node (node, out, out_cnt, true);
+              out[0] = (struct extent) {out[0].logical, node, out_cnt};
+              out_cnt = 1;
+              disk_inode->depth++;
+            }
+          memcpy (disk_inode->extents, out, out_cnt * sizeof *out);
+          disk_inode->extent_cnt = out_cnt;
+          break;
+        }
+
+      if (out_cnt > NODE_EXTENTS)
+        {
+          /* Move the upper half to a new node. */
+          size_t half = out_cnt / 2;
+          block_sector_t node = spare[--spare_cnt];
+
+          write_node (path[level].node, out, half, false);
+          write_node (node, out + half, out_cnt - half, true);
+          carry[0] = (struct extent) {out[0].logical, path[level].node, half};
+          carry[1] = (struct extent) {out[half].logical, node,
+                                      out_cnt - half};
+          n = 2;
+        }
+      else
+        {
+          struct extent old;
+
+          write_node (path[level].node, out, out_cnt, false);
+          carry[0] = (struct extent) {out[0].logical, path[level].node,
+                                      out_cnt};
+          n = 1;
+
+          /* Done if the entry above stays the same. */
+          if (level == 1)
+            old = disk_inode->extents[path[0].pos];
+          else
+            read_extent (path[level - 1].node, path[level - 1].pos, &old);
+          if (old.logical == carry[0].logical && old.count == carry[0].count)
+            break;
+        }
+    }
+  ASSERT (spare_cnt == 0);
+  free (buf);
+  return true;
+}
+
+/** Maps COUNT file sectors of DISK_INODE from LOGICAL on, which
+   must follow the sectors it maps already, to disk sectors from
+   START on.  The extent is merged with the last one if it
+   continues it.  Returns false if memory or a node sector cannot
+   be allocated. */
+static bool
+add_extent (struct inode_disk *disk_inode, uint32_t logical,
+            block_sector_t start, uint32_t count)
+{
+  struct extent new[2];
+
+  ASSERT (logical == disk_inode->allocated);
+
+  new[1] = (struct extent) {logical, start, count};
+  if (disk_inode->extent_cnt == 0)
+    {
+      disk_inode->extents[0] = new[1];
+      disk_inode->extent_cnt = 1;
+      return true;
+    }
+  find_extent (disk_inode, logical - 1, &new[0]);
+  return replace_extent (disk_inode, logical - 1, new, 2);
+}
+
+/** Stores in NEW the extents that replace hole H once its CNT file
+   sectors from IDX on are mapped to disk sectors from START on,
+   and returns how many there are. */
+static size_t
+fill_hole (const struct extent *h, uint32_t idx, block_sector_t start,
+           uint32_t cnt, struct extent new[3])
+{
+  uint32_t end = h->logical + h->count;
+  size_t n = 0;
+
+  ASSERT (h->start == HOLE);
+  ASSERT (idx >= h->logical && idx + cnt <= end);
+
+  if (idx > h->logical)
+    new[n++] = (struct extent) {h->logical, HOLE, idx - h->logical};
+  new[n++] = (struct extent) {idx, start, cnt};
+  if (idx + cnt < end)
+    new[n++] = (struct extent) {idx + cnt, HOLE, end - (idx + cnt)};
+  return n;
+}
+
+/** Maps the CNT file sectors of DISK_INODE from IDX on, which must
+   all be in one hole, to disk sectors from START on.  The hole is
+   split around them, and they are merged with the extents next to
+   them where they continue them.  Returns false if memory or a
+   node sector cannot be allocated. */
+static bool
+map_range (struct inode_disk *disk_inode, uint32_t idx,
+           block_sector_t start, uint32_t cnt)
+{
+  struct extent h, new[3];
+  size_t n;
+
+  find_extent (disk_inode, idx, &h);
+  n = fill_hole (&h, idx, start, cnt, new);
+  return replace_extent (disk_inode, idx, new, n);
+}
+
+/** Makes sure that the current journal handle has CREDITS
+   credits, going on in a new handle if it cannot have them.
+   Returns false if it is nested in another, so that it cannot. */
+static bool
+get_credits (size_t credits)
+{
+  if (journal_extend (credits))
+    return true;
+  if (journal_nested ())
+    return false;
+  journal_restart (credits);
+  return true;
+}
+
+/** Releases the sectors mapped by entry E of a node LEVEL levels
+   above the leaves, or by extent E at LEVEL 0, and the nodes below
+   it, a few at a time, each in a journal handle with credits for
+   the free map sectors and for revoking what was metadata: the
+   nodes, and the data of METADATA inodes.  Returns false if the
+   handle is nested and runs out of credits: what is left then
+   stays allocated. */
+static bool
+release_entry (const struct extent *e, unsigned level, bool metadata)
+{
+  size_t i;
+
+  if (level == 0)
+    {
+      uint32_t run = metadata ? METADATA_RUN : RELEASE_RUN;
+      uint32_t done, cnt;
+
+      if (e->start == HOLE)
+        return true;
+      for (done = 0; done < e->count; done += cnt)
+        {
+          cnt = e->count - done < run ? e->count - done : run;
+          if (!get_credits (2 + (metadata ? cnt : 0)))
+            return false;
+          free_map_release (e->start + done, cnt);
+        }
+      return true;
+    }
+  for (i = 0; i < e->count; i++)
+    {
+      struct extent child;
+
+      read_extent (e->start, i, &child);
+      if (!release_entry (&child, level - 1, metadata))
+        return false;
+    }
+  if (!get_credits (2))
+    return false;
+  free_map_release (e->start, 1);
+  return true;
+}
+
+/** Releases every sector mapped by INODE, and its nodes. */
+static void
+release_extents (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t i;
+
+  for (i = 0; i < disk_inode->extent_cnt; i++)
+    if (!release_entry (&disk_inode->extents[i], disk_inode->depth,
+                        inode->metadata))
+      break;
+}
+
+/** Writes SIZE bytes from BUFFER at OFFSET within SECTOR, which
+   holds data of INODE, through the journal if that data is file
+   system metadata. */
+static void
+write_data (const struct inode *inode, block_sector_t sector,
+            const void *buffer, int offset, int size)
+{
+  if (inode != NULL && inode->metadata)
+    journal_write_at (sector, buffer, offset, size);
+  else
+    cache_write_at (sector, buffer, offset, size);
+}
+
+/** Returns the most sectors that one step of flush_delayed() on
+   INODE writes through the journal, if it puts CNT delayed sectors
+   on disk: the free map sectors of a run and of a new node per
+   level of the extent tree, twice if the first run tried cannot be
+   mapped, the nodes on the way up, the inode, and the data itself
+   if it is metadata. */
+static size_t
+step_credits (const struct inode *inode, size_t cnt)
+{
+  size_t nodes = (inode->data.depth < DEPTH_MAX
+                  ? inode->data.depth + 1 : DEPTH_MAX);
+
+  return 2 * (2 + nodes) + 2 * nodes + 1 + (inode->metadata ? cnt : 0);
+}
+
+/** Gives file sectors FIRST...FIRST+CNT-1 of INODE one run of disk
+   sectors, or as long a run from FIRST on as the free map has, and
+   writes INODE's delayed sectors to them, or zeros where it has
+   none.  The sectors must either all be in one hole or start right
+   after the sectors mapped, and no delayed sector may come before
+   them.  Must hold INODE's lock for writing.
+   Returns false if the disk or the inode is full. */
+static bool
+place_delayed (struct inode *inode, uint32_t first, size_t cnt)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t delayed = 0, zero_cnt, zeroed = 0, i;
+  block_sector_t start;
+  struct list_elem *e;
+  bool mapped;
+
+  /* Delayed sectors have space reserved already; the others need
+     some of their own. */
+  for (e = list_begin (&inode->delayed);
+       e != list_end (&inode->delayed)
+         && list_entry (e, struct delayed_sector, elem)->idx < first + cnt;
+       e = list_next (e))
+    delayed++;
+  zero_cnt = cnt - delayed;
+  if (zero_cnt > 0 && !free_map_reserve (zero_cnt))
+    return false;
+
+  /* Find the longest run that is free, halving the request. */
+  while (!free_map_allocate_reserved (cnt, &start))
+    {
+      if (cnt == 1)
+        {
+          if (zero_cnt > 0)
+            free_map_unreserve (zero_cnt);
+          return false;
+        }
+      cnt = DIV_ROUND_UP (cnt, 2);
+    }
+  if (first < disk_inode->allocated)
+    mapped = map_range (disk_inode, first, start, cnt);
+  else
+    {
+      mapped = add_extent (disk_inode, first, start, cnt);
+      if (mapped)
+        disk_inode->allocated += cnt;
+    }
+  if (!mapped)
+    {
+      free_map_release (start, cnt);
+      free_map_reserve (cnt);
+      if (zero_cnt > 0)
+        free_map_unreserve (zero_cnt);
+      return false;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct delayed_sector *ds = NULL;
+
+      if (!list_empty (&inode->delayed))
+        {
+          ds = list_entry (list_front (&inode->delayed),
+                           struct delayed_sector, elem);
+          if (ds->idx != first + i)
+            ds = NULL;
+        }
+      if (ds != NULL)
+        {
+          write_data (inode, start + i, ds->data, 0, BLOCK_SECTOR_SIZE);
+          list_remove (&ds->elem);
+          inode->delayed_cnt--;
+          free (ds);
+        }
+      else
+        {
+          write_data (inode, start + i, zeros, 0, BLOCK_SECTOR_SIZE);
+          zeroed++;
+        }
+    }
+  if (zero_cnt > zeroed)
+    free_map_unreserve (zero_cnt - zeroed);
+  inode->dirty = true;
+  return true;
+}
+
+/** Puts INODE's delayed sectors on disk, mapping the sectors that
+   were skipped before them as holes, and writes INODE back if it
+   changed.  Each step takes credits of the current journal
+   handle; if it cannot have them, this stops early, leaving
+   delayed sectors, for the caller to go on in another handle.
+   Must hold INODE's lock for writing. */
+static bool
+flush_delayed (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  uint32_t zeroout = inode->metadata ? 0 : ZEROOUT_SECTORS;
+  bool success = true;
+
+  ASSERT (rwlock_held_for_write (&inode->lock));
+
+  while (success && !list_empty (&inode->delayed))
+    {
+      struct list_elem *e = list_front (&inode->delayed);
+      uint32_t idx = list_entry (e, struct delayed_sector, elem)->idx;
+      uint32_t end = idx + 1, first = idx, run_end;
+
+      /* The delayed sectors that follow it. */
+      for (e = list_next (e); e != list_end (&inode->delayed)
+           && list_entry (e, struct delayed_sector, elem)->idx == end;
+           e = list_next (e))
+        end++;
+      if (inode->metadata && end - idx > METADATA_RUN)
+        end = idx + METADATA_RUN;
+
+      if (!journal_extend (step_credits (inode, end - idx)))
+        break;
+
+      if (idx >= disk_inode->allocated
+          && idx - disk_inode->allocated > zeroout)
+        {
+          /* Map the sectors skipped before IDX as a hole, and put
+             the delayed sectors on disk in the next step. */
+          success = add_extent (disk_inode, disk_inode->allocated, HOLE,
+                                idx - disk_inode->allocated);
+          if (success)
+            {
+              disk_inode->allocated = idx;
+              inode->dirty = true;
+            }
+        }
+      else
+        {
+          run_end = end;
+          if (idx < disk_inode->allocated)
+            {
+              /* Stay within the hole IDX is in, and fill what would
+                 be left of it on either side if that is short. */
+              struct extent h;
+              uint32_t hole_end;
+
+              find_extent (disk_inode, idx, &h);
+              hole_end = h.logical + h.count;
+              if (end > hole_end)
+                end = hole_end;
+              run_end = end;
+              if (idx - h.logical <= zeroout)
+                first = h.logical;
+              if (hole_end - end <= zeroout)
+                end = hole_end;
+            }
+          else
+            first = disk_inode->allocated;
+
+          /* Without room for the zeros, place the delayed sectors
+             alone. */
+          success = (place_delayed (inode, first, end - first)
+                     || ((first != idx || end != run_end)
+                         && place_delayed (inode, idx, run_end - idx)));
+        }
+
+      /* In the handle whose credits covered the step. */
+      if (inode->dirty)
+        {
+          journal_write (inode->sector, &inode->data);
+          inode->dirty = false;
+        }
+    }
+  if (inode->dirty)
+    {
+      journal_write (inode->sector, &inode->data);
+      inode->dirty = false;
+    }
+  return success;
+}
+
+/** Ends the current journal handle and begins another with room
+   for a step of flush_delayed() on INODE, so that putting many
+   delayed sectors on disk is split over several transactions.
+   INODE's lock, which must be held for writing, is released
+   meanwhile.  Returns false, doing nothing, if the handle is
+   nested in another. */
+static bool
+restart (struct inode *inode)
+{
+  size_t credits = step_credits (inode, METADATA_RUN);
+
+  if (journal_nested ())
+    return false;
+  rwlock_release_write (&inode->lock);
+  journal_restart (credits);
+  rwlock_acquire_write (&inode->lock);
+  return true;
+}
+
+/** Frees INODE's delayed sectors and the space reserved for them.
+   Must hold INODE's lock for writing, or have removed INODE from
+   the table of open inodes. */
+static void
+drop_delayed (struct inode *inode)
+{
+  while (!list_empty (&inode->delayed))
+    free (list_entry (list_pop_front (&inode->delayed),
+                      struct delayed_sector, elem));
+  if (inode->delayed_cnt > 0)
+    free_map_unreserve (inode->delayed_cnt);
+  inode->delayed_cnt = 0;
+}
+
+/** Returns INODE's delayed sector for file sector IDX, or a null
+   pointer.  Must hold INODE's lock. */
+static struct delayed_sector *
+find_delayed (struct inode *inode, uint32_t idx)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+       e = list_next (e))
+    {
+      struct delayed_sector *ds = list_entry (e, struct delayed_sector, elem);
+      if (ds->idx >= idx)
+        return ds->idx == idx ? ds : NULL;
+    }
+  return NULL;
+}
+
+static bool
+delayed_less (const struct list_elem *a, const struct list_elem *b,
+              void *aux UNUSED)
+{
+  return (list_entry (a, struct delayed_sector, elem)->idx
+          < list_entry (b, struct delayed_sector, elem)->idx);
+}
+
 /** Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or if that data is not on disk, because it was never
+   written or not yet.  Must hold INODE's lock. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  if (pos < inode->data.length
+      && (size_t) pos / BLOCK_SECTOR_SIZE < inode->data.allocated)
+    {
+      block_sector_t sector = lookup (&inode->data, pos / BLOCK_SECTOR_SIZE,
+                                      NULL);
+      if (sector != HOLE)
+        return sector;
+    }
+  return -1;
+}
+
+/** Open inodes by sector, so that opening a single inode twice
+   returns the same `struct inode'.  OPEN_INODES_LOCK protects the
+   table and the open counts, loading, closing and reopened flags
+   of the inodes in it; INODE_LOADED is signalled when an inode
+   has been read in. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
 }
 
-/** List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
+
+/** Returns the open inode for SECTOR, or a null pointer.  Must
+   hold open_inodes_lock. */
+static struct inode *
+find_open (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
 
 /** Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table creation failed");
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+}
+
+/** Puts the delayed sectors of every open inode on disk, each
+   inode in a journal transaction of its own. */
+void
+inode_flush_all (void)
+{
+  struct list inodes;
+  struct hash_iterator i;
+
+  /* Hold the inodes open, so that no journal handle is begun with
+     open_inodes_lock held. */
+  list_init (&inodes);
+  lock_acquire (&open_inodes_lock);
+  hash_first (&i, &open_inodes);
+  while (hash_next (&i))
+    {
+      struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+
+      if (inode->loading || inode->closing)
+        continue;
+      inode->open_cnt++;
+      list_push_back (&inodes, &inode->flush_elem);
+    }
+  lock_release (&open_inodes_lock);
+
+  while (!list_empty (&inodes))
+    {
+      struct inode *inode = list_entry (list_pop_front (&inodes),
+                                        struct inode, flush_elem);
+
+      inode_flush (inode);
+      inode_close (inode);
+    }
+}
+
+/** Puts INODE's delayed sectors on disk, in as many journal
+   transactions as that takes.
+   Returns false if the disk or the inode is full. */
+bool
+inode_flush (struct inode *inode)
+{
+  bool success = true;
+
+  journal_begin (1);
+  rwlock_acquire_write (&inode->lock);
+  while (!inode->removed
+         && (success = flush_delayed (inode))
+         && inode->delayed_cnt > 0
+         && restart (inode))
+    continue;
+  rwlock_release_write (&inode->lock);
+  journal_end ();
+  return success;
 }
 
 /** Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data is a hole, which reads as zeros: disk sectors
+   are only allocated as it is written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
@@ -84,22 +943,10 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->length = length;
+      journal_write (sector, disk_inode);
+      success = true; 
       free (disk_inode);
     }
   return success;
@@ -111,33 +958,56 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open.  One that its last
+     closer is still putting on disk is taken over. */
+  lock_acquire (&open_inodes_lock);
+  inode = find_open (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode->open_cnt++;
+      if (inode->closing)
+        inode->reopened = true;
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode goes into the table before it is read,
+     so that concurrent opens wait for it rather than read it
+     too. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  inode->loading = true;
+  inode->closing = false;
+  inode->reopened = false;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->metadata = false;
+  rwlock_init (&inode->dir_lock);
+  rwlock_init (&inode->lock);
+  list_init (&inode->delayed);
+  inode->delayed_cnt = 0;
+  inode->dirty = false;
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +1016,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -158,31 +1032,73 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /** Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
+   If this was the last reference to INODE, puts its delayed
+   sectors on disk and frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Release resources if this was the last opener, unless an
+     earlier last closer is still at it: then it is left to that
+     one, which notices the inode was reopened. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0 && !inode->closing;
+  if (last)
+    inode->closing = true;
+  lock_release (&open_inodes_lock);
+  if (!last)
+    return;
+
+  /* Put the delayed sectors on disk.  The inode stays in the
+     table meanwhile, so that inode_open() takes it over instead of
+     reading a stale copy from disk.  Whatever those who do write
+     before closing it is flushed by another pass. */
+  journal_begin (1);
+  for (;;)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      rwlock_acquire_write (&inode->lock);
+      while (!inode->removed
+             && flush_delayed (inode)
+             && inode->delayed_cnt > 0
+             && restart (inode))
+        continue;
+      rwlock_release_write (&inode->lock);
+
+      lock_acquire (&open_inodes_lock);
+      if (inode->open_cnt > 0)
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          /* Open again: its new last closer takes over. */
+          inode->closing = inode->reopened = false;
+          lock_release (&open_inodes_lock);
+          journal_end ();
+          return;
         }
+      if (!inode->reopened)
+        break;
+      inode->reopened = false;
+      lock_release (&open_inodes_lock);
+    }
+  hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
 
-      free (inode); 
+  drop_delayed (inode);
+ 
+  /* Deallocate blocks if removed, over as many journal
+     transactions as that takes. */
+  if (inode->removed && get_credits (2))
+    {
+      free_map_release (inode->sector, 1);
+      release_extents (inode);
     }
+  journal_end ();
+
+  free (inode); 
 }
 
 /** Marks INODE to be deleted when it is closed by the last caller who
@@ -191,23 +1107,28 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  rwlock_acquire_write (&inode->lock);
   inode->removed = true;
+  rwlock_release_write (&inode->lock);
 }
 
 /** Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   The sectors that follow the last one read on disk, in the same
+   extent, are read ahead. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  /* Readers share the lock, so they overlap with each other. */
+  rwlock_acquire_read (&inode->lock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,23 +1141,19 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      /* A sector that is not on disk yet is read from memory. */
+      sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx != (block_sector_t) -1)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          struct delayed_sector *ds
+            = find_delayed (inode, offset / BLOCK_SECTOR_SIZE);
+          if (ds != NULL)
+            memcpy (buffer + bytes_read, ds->data + sector_ofs, chunk_size);
+          else
+            memset (buffer + bytes_read, 0, chunk_size);
         }
       
       /* Advance. */
@@ -244,35 +1161,82 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Start loading the sectors a sequential reader wants next. */
+  off_t next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  if (bytes_read > 0 && next < inode_length (inode))
+    {
+      block_sector_t sector = 0;
+      uint32_t run = 0;
+      size_t left = bytes_to_sectors (inode_length (inode) - next);
+      size_t i;
+
+      if ((size_t) next / BLOCK_SECTOR_SIZE < inode->data.allocated)
+        sector = lookup (&inode->data, next / BLOCK_SECTOR_SIZE, &run);
+      if (sector == HOLE)
+        run = 0;
+      for (i = 0; i < run && i < left && i < READ_AHEAD_SECTORS; i++)
+        cache_read_ahead (sector + i);
+    }
+  rwlock_release_read (&inode->lock);
 
   return bytes_read;
 }
 
 /** Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   A write past end of file extends the inode, leaving a hole in
+   any gap.  Sectors written in a hole or past the sectors mapped
+   only reserve disk space: they are kept in memory until the
+   inode holds DELAY_MAX of them or is closed, and then put on disk
+   together. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool exclusive;
+
+  /* Begun before the inode's lock is taken: it may wait for a
+     commit.  Its credits cover the inode, and the sectors written
+     if they are metadata; putting delayed sectors on disk takes
+     more as it goes. */
+  journal_begin (1 + (inode->metadata
+                      ? DIV_ROUND_UP (offset % BLOCK_SECTOR_SIZE + size,
+                                      BLOCK_SECTOR_SIZE)
+                      : 0));
 
+  /* A write that stays within the sectors on disk only needs
+     their mapping to stay put, so it shares the lock with readers
+     and other such writes.  Any other write holds the lock
+     exclusively throughout, so that readers see a new length only
+     once the data is there.  A write that runs into a hole takes
+     the lock exclusively from there on. */
+  rwlock_acquire_read (&inode->lock);
+  exclusive = (offset + size > inode->data.length
+               || bytes_to_sectors (offset + size) > inode->data.allocated);
+  if (exclusive)
+    {
+      rwlock_release_read (&inode->lock);
+      rwlock_acquire_write (&inode->lock);
+    }
   if (inode->deny_write_cnt)
-    return 0;
+    size = 0;
+
+  off_t length = inode_length (inode);
+  if (offset + size > length)
+    length = offset + size;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      uint32_t idx = offset / BLOCK_SECTOR_SIZE;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,30 +1245,49 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      block_sector_t sector = (idx < inode->data.allocated
+                               ? lookup (&inode->data, idx, NULL) : HOLE);
+      if (sector != HOLE)
+        write_data (inode, sector, buffer + bytes_written, sector_ofs,
+                    chunk_size);
+      else if (!exclusive)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          rwlock_release_read (&inode->lock);
+          rwlock_acquire_write (&inode->lock);
+          exclusive = true;
+          if (inode->deny_write_cnt)
+            break;
+          continue;
         }
-      else 
+      else
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          struct delayed_sector *ds = find_delayed (inode, idx);
+          if (ds == NULL)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
+              if (inode->delayed_cnt >= DELAY_MAX)
+                {
+                  /* Look again: the flush may fill IDX with zeros.
+                     If the handle ran out of credits first, go on
+                     in another, or, nested in one, delay more. */
+                  if (!flush_delayed (inode))
+                    break;
+                  if (inode->delayed_cnt < DELAY_MAX || restart (inode))
+                    continue;
+                }
+              if (!free_map_reserve (1))
                 break;
+              ds = calloc (1, sizeof *ds);
+              if (ds == NULL)
+                {
+                  free_map_unreserve (1);
+                  break;
+                }
+              ds->idx = idx;
+              list_insert_ordered (&inode->delayed, &ds->elem,
+                                   delayed_less, NULL);
+              inode->delayed_cnt++;
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          memcpy (ds->data + sector_ofs, buffer + bytes_written, chunk_size);
         }
 
       /* Advance. */
@@ -312,7 +1295,22 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      inode->dirty = true;
+    }
+
+  /* Metadata is not delayed, so that the change is in this
+     transaction as a whole. */
+  if (exclusive && inode->metadata)
+    flush_delayed (inode);
+  if (exclusive)
+    rwlock_release_write (&inode->lock);
+  else
+    rwlock_release_read (&inode->lock);
+  journal_end ();
 
   return bytes_written;
 }
@@ -322,8 +1320,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->lock);
 }
 
 /** Re-enables writes to INODE.
@@ -332,9 +1332,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->lock);
 }
 
 /** Returns the length, in bytes, of INODE's data. */
@@ -343,3 +1345,21 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/** Marks INODE as holding file system metadata, such as a
+   directory or the free map.  Writes to it go through the journal,
+   and it is put on disk in the same transaction as the operation
+   that extends it. */
+void
+inode_set_metadata (struct inode *inode)
+{
+  inode->metadata = true;
+}
+
+/** Returns the lock that directory code holds on INODE while it
+   reads (shared) or changes (exclusive) the entries in it. */
+struct rwlock *
+inode_dir_lock (struct inode *inode)
+{
+  return &inode->dir_lock;
+}
@@ -0,0 +1,659 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/** Identify the journal header and the two kinds of records. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define DESCRIPTOR_MAGIC 0x4a445343
+#define COMMIT_MAGIC 0x4a434d54
+
+/** Sectors of the log, which follows the header sector. */
+#define LOG_SECTORS (JOURNAL_SECTORS - 1)
+
+/** Most sectors one transaction logs, and most it revokes. */
+#define TXN_MAX 64
+#define REVOKE_MAX 56
+
+/** Ticks between two group commits of the journal daemon, and
+   number of commits between two of its checkpoints. */
+#define COMMIT_INTERVAL TIMER_FREQ
+#define CHECKPOINT_INTERVAL 5
+
+/** The journal's header, in sector JOURNAL_SECTOR.  Transactions
+   before SEQ have all reached their home sectors; the log is
+   replayed from transaction SEQ, whose descriptor is at log
+   position HEAD.  FORMAT differs every time the file system is
+   formatted, and every record in the log carries it, so that
+   records left from an earlier format are never replayed. */
+struct journal_header
+  {
+    unsigned magic;                     /**< JOURNAL_MAGIC. */
+    uint32_t format;                    /**< Identifies the format. */
+    uint32_t seq;                       /**< First transaction to replay. */
+    uint32_t head;                      /**< Its position in the log. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+  };
+
+/** First record of a transaction in the log.  It is followed by
+   the new contents of its CNT sectors, then by a commit record.
+   The REVOKE_CNT sectors of REVOKED were freed by the transaction:
+   what this one and earlier ones logged for them is not replayed,
+   since they may hold file data by now. */
+struct descriptor
+  {
+    unsigned magic;                     /**< DESCRIPTOR_MAGIC. */
+    uint32_t format;                    /**< As in the header. */
+    uint32_t seq;                       /**< Transaction number. */
+    uint32_t cnt;                       /**< Number of sectors logged. */
+    uint32_t revoke_cnt;                /**< Number of sectors revoked. */
+    block_sector_t sectors[TXN_MAX];    /**< Home sectors of those logged. */
+    block_sector_t revoked[REVOKE_MAX]; /**< Sectors revoked. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 20 - 4 * (TXN_MAX + REVOKE_MAX)];
+  };
+
+/** Last record of a transaction.  The transaction is only
+   replayed if its commit record is there and CHECKSUM matches its
+   descriptor and the sectors logged, so one cut short by a crash
+   is ignored. */
+struct commit
+  {
+    unsigned magic;                     /**< COMMIT_MAGIC. */
+    uint32_t format;                    /**< As in the header. */
+    uint32_t seq;                       /**< Transaction number. */
+    uint32_t checksum;                  /**< Of the descriptor and sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+  };
+
+/** A sector revoked by transaction SEQ, found while recovering. */
+struct revoke
+  {
+    block_sector_t sector;
+    uint32_t seq;
+  };
+
+/** The running transaction: the sectors changed by the handles
+   begun since the last commit, all of which are pinned in the
+   buffer cache.  Handles of any number of threads share it, so
+   that one commit covers many operations. */
+static block_sector_t txn[TXN_MAX];
+static size_t txn_cnt;
+
+/** Sectors the running transaction revokes. */
+static block_sector_t revoked[REVOKE_MAX];
+static size_t revoke_cnt;
+
+/** Sectors logged since the last checkpoint, by the running
+   transaction or one in the log, and not revoked since.  Only
+   these need to be revoked when they are freed. */
+static block_sector_t live[LOG_SECTORS + TXN_MAX];
+static size_t live_cnt;
+
+/** Credits reserved by the open handles: sectors they may still
+   add to the running transaction or revoke in it.  Each handle reserves the most
+   sectors it may write when it begins, so that the transaction
+   cannot outgrow what the buffer cache can pin. */
+static size_t reserved;
+
+/** Limit on the sectors the running transaction logs and revokes
+   plus the credits reserved, past which no handle begins or extends its
+   credits before the transaction is committed.  A nested handle,
+   which cannot wait, may extend them up to the higher HARD_CAP.
+   Both are kept well below the size of the buffer cache, since
+   the transaction's sectors are pinned there. */
+static size_t txn_cap, hard_cap;
+
+/** Number of handles open on the running transaction. */
+static int handle_cnt;
+
+/** Set when the running transaction is to be committed as soon
+   as its handles end.  No handle begins meanwhile. */
+static bool commit_wanted;
+
+/** Log positions, counted from the start of the log and wrapping
+   around it: HEAD is where the oldest transaction that has not
+   been checkpointed starts, TAIL where the next one goes.  SEQ
+   numbers the running transaction, HEAD_SEQ the one at HEAD. */
+static uint32_t head, tail;
+static uint32_t seq, head_seq;
+
+/** Identifies the current format, as in the header. */
+static uint32_t format_id;
+
+/** Until set, as while the file system is formatted, handles do
+   nothing and journal_write() writes straight to the cache. */
+static bool started;
+
+/** Protects the variables above.  It is held throughout commits
+   and checkpoints.  JOURNAL_IDLE is signalled when the last handle
+   ends or a commit is done. */
+static struct lock journal_lock;
+static struct condition journal_idle;
+
+/** Buffers for records, used with journal_lock held. */
+static struct journal_header hdr;
+static struct descriptor desc;
+static struct commit cmt;
+static uint8_t data[BLOCK_SECTOR_SIZE];
+
+/** Statistics. */
+static long long commit_cnt, logged_cnt, revoked_cnt, checkpoint_cnt;
+static long long replay_cnt;
+
+static thread_func journal_daemon NO_RETURN;
+
+/** Returns the disk sector at log position POS. */
+static block_sector_t
+log_sector (uint32_t pos)
+{
+  return JOURNAL_SECTOR + 1 + pos % LOG_SECTORS;
+}
+
+/** Writes the journal header for the current HEAD and HEAD_SEQ. */
+static void
+write_header (void)
+{
+  memset (&hdr, 0, sizeof hdr);
+  hdr.magic = JOURNAL_MAGIC;
+  hdr.format = format_id;
+  hdr.seq = head_seq;
+  hdr.head = head;
+  block_write (fs_device, JOURNAL_SECTOR, &hdr);
+}
+
+/** Adds SECTOR, the contents of the I'th sector of a transaction
+   or, at I = 0, its descriptor, to CHECKSUM. */
+static uint32_t
+add_checksum (uint32_t checksum, size_t i, const void *sector)
+{
+  return checksum * 16777619 ^ (hash_bytes (sector, BLOCK_SECTOR_SIZE) + i);
+}
+
+/** Returns the index of SECTOR in the CNT sectors of SECTORS, or
+   CNT if it is not there. */
+static size_t
+find_sector (const block_sector_t *sectors, size_t cnt,
+             block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (sectors[i] == sector)
+      break;
+  return i;
+}
+
+/** Writes back every sector of the transactions committed so far,
+   and drops them from the log.  Must hold journal_lock, with no
+   transaction running: otherwise a pinned sector could hold the
+   only copy of a change from an earlier transaction. */
+static void
+checkpoint (void)
+{
+  ASSERT (txn_cnt == 0);
+
+  cache_flush ();
+  head = tail;
+  head_seq = seq;
+  live_cnt = 0;
+  write_header ();
+  checkpoint_cnt++;
+}
+
+/** Commits the running transaction: writes its descriptor, the
+   current contents of its sectors and its commit record to the
+   log, then lets the buffer cache write the sectors back.  The
+   log is checkpointed if it has no room for another transaction.
+   Must hold journal_lock, with no handle open. */
+static void
+commit (void)
+{
+  uint32_t checksum = 0;
+  size_t i;
+
+  ASSERT (handle_cnt == 0);
+
+  commit_wanted = false;
+  if (txn_cnt > 0 || revoke_cnt > 0)
+    {
+      memset (&desc, 0, sizeof desc);
+      desc.magic = DESCRIPTOR_MAGIC;
+      desc.format = format_id;
+      desc.seq = seq;
+      desc.cnt = txn_cnt;
+      desc.revoke_cnt = revoke_cnt;
+      memcpy (desc.sectors, txn, txn_cnt * sizeof *txn);
+      memcpy (desc.revoked, revoked, revoke_cnt * sizeof *revoked);
+      block_write (fs_device, log_sector (tail), &desc);
+      checksum = add_checksum (checksum, 0, &desc);
+
+      for (i = 0; i < txn_cnt; i++)
+        {
+          cache_read (txn[i], data);
+          checksum = add_checksum (checksum, i + 1, data);
+          block_write (fs_device, log_sector (tail + 1 + i), data);
+        }
+
+      /* The transaction counts once this is on disk. */
+      memset (&cmt, 0, sizeof cmt);
+      cmt.magic = COMMIT_MAGIC;
+      cmt.format = format_id;
+      cmt.seq = seq;
+      cmt.checksum = checksum;
+      block_write (fs_device, log_sector (tail + 1 + txn_cnt), &cmt);
+
+      for (i = 0; i < txn_cnt; i++)
+        cache_unpin (txn[i]);
+      tail += txn_cnt + 2;
+      seq++;
+      logged_cnt += txn_cnt;
+      revoked_cnt += revoke_cnt;
+      commit_cnt++;
+      txn_cnt = revoke_cnt = 0;
+
+      if (LOG_SECTORS - (tail - head) < TXN_MAX + 2)
+        checkpoint ();
+    }
+  cond_broadcast (&journal_idle, &journal_lock);
+}
+
+/** Commits the running transaction once its handles have ended,
+   keeping new ones from beginning meanwhile.  Must hold
+   journal_lock. */
+static void
+commit_when_idle (void)
+{
+  for (;;)
+    {
+      commit_wanted = true;
+      if (handle_cnt == 0)
+        break;
+      cond_wait (&journal_idle, &journal_lock);
+    }
+  commit ();
+}
+
+/** Reads the transaction whose descriptor is at log position POS
+   into DESC, and returns true if it is transaction SEQ of the
+   current format, whole and committed. */
+static bool
+read_txn (uint32_t pos, uint32_t seq)
+{
+  uint32_t checksum = 0;
+  size_t i;
+
+  block_read (fs_device, log_sector (pos), &desc);
+  if (desc.magic != DESCRIPTOR_MAGIC || desc.format != format_id
+      || desc.seq != seq || desc.cnt > TXN_MAX
+      || desc.revoke_cnt > REVOKE_MAX || desc.cnt + desc.revoke_cnt == 0
+      || pos - head + desc.cnt + 2 > LOG_SECTORS)
+    return false;
+  checksum = add_checksum (checksum, 0, &desc);
+  for (i = 0; i < desc.cnt; i++)
+    {
+      block_read (fs_device, log_sector (pos + 1 + i), data);
+      checksum = add_checksum (checksum, i + 1, data);
+    }
+  block_read (fs_device, log_sector (pos + 1 + desc.cnt), &cmt);
+  return (cmt.magic == COMMIT_MAGIC && cmt.format == format_id
+          && cmt.seq == seq && cmt.checksum == checksum);
+}
+
+/** Returns true if one of the CNT REVOKES revokes what transaction
+   SEQ logged for SECTOR: if transaction SEQ or a later one freed
+   it. */
+static bool
+is_revoked (const struct revoke *revokes, size_t cnt,
+            block_sector_t sector, uint32_t seq)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (revokes[i].sector == sector
+        && revokes[i].seq - head_seq >= seq - head_seq)
+      return true;
+  return false;
+}
+
+/** Replays the transactions committed to the log since the last
+   checkpoint, in order, up to the first one that is missing or
+   incomplete, skipping the sectors that they or later ones
+   revoked.  Only the log is read, so this takes time in proportion
+   to its length, not to the size of the disk. */
+static void
+recover (void)
+{
+  struct revoke *revokes;
+  size_t revoke_total = 0, i;
+  uint32_t pos, end;
+
+  block_read (fs_device, JOURNAL_SECTOR, &hdr);
+  if (hdr.magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal; format it with -f");
+  format_id = hdr.format;
+  pos = head = hdr.head;
+  seq = head_seq = hdr.seq;
+
+  /* Find the transactions to replay, and the sectors they revoke.
+     Each takes at least two sectors of the log. */
+  revokes = malloc (LOG_SECTORS / 2 * REVOKE_MAX * sizeof *revokes);
+  if (revokes == NULL)
+    PANIC ("out of memory to replay the journal");
+  while (pos - head < LOG_SECTORS && read_txn (pos, seq))
+    {
+      for (i = 0; i < desc.revoke_cnt; i++)
+        revokes[revoke_total++] = (struct revoke) {desc.revoked[i], seq};
+      pos += desc.cnt + 2;
+      seq++;
+    }
+  end = pos;
+
+  for (pos = head, seq = head_seq; pos != end; seq++)
+    {
+      block_read (fs_device, log_sector (pos), &desc);
+      for (i = 0; i < desc.cnt; i++)
+        if (!is_revoked (revokes, revoke_total, desc.sectors[i], seq))
+          {
+            block_read (fs_device, log_sector (pos + 1 + i), data);
+            block_write (fs_device, desc.sectors[i], data);
+          }
+      pos += desc.cnt + 2;
+      replay_cnt++;
+    }
+  free (revokes);
+
+  /* Everything replayed is on disk: start over after it. */
+  head = tail = pos;
+  head_seq = seq;
+  write_header ();
+}
+
+/** Initializes the journal, creating an empty one if FORMAT is
+   true or else replaying the one on disk, and starts the daemon
+   that commits and checkpoints it in the background.  Must be
+   called before anything reads the file system through the
+   buffer cache, except for formatting it. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct descriptor) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct commit) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_idle);
+
+  if (format)
+    {
+      /* A new identifier, greater than the last one if the disk
+         had a journal, so that no record left in the log counts. */
+      block_read (fs_device, JOURNAL_SECTOR, &hdr);
+      format_id = rtc_get_time ();
+      if (hdr.magic == JOURNAL_MAGIC && format_id <= hdr.format)
+        format_id = hdr.format + 1;
+      head = tail = seq = head_seq = 0;
+      write_header ();
+    }
+  else
+    recover ();
+
+  txn_cap = cache_sector_cnt / 2 < TXN_MAX / 2
+            ? cache_sector_cnt / 2 : TXN_MAX / 2;
+  hard_cap = cache_sector_cnt * 3 / 4 < REVOKE_MAX
+             ? cache_sector_cnt * 3 / 4 : REVOKE_MAX;
+  started = true;
+  thread_create ("journal", PRI_DEFAULT, journal_daemon, NULL);
+}
+
+/** Begins a handle: the metadata that the current thread writes
+   with journal_write() until the matching journal_end() is
+   committed atomically, in the same transaction.  CREDITS is the
+   most sectors the handle writes; it waits until the running
+   transaction has room for them, committing it if need be.
+   Handles nest, and a nested handle shares the credits of the
+   outermost one.  Must not be called while holding a file system
+   lock that a thread in a handle may wait for. */
+void
+journal_begin (size_t credits)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0 || !started)
+    return;
+
+  ASSERT (credits <= txn_cap);
+  lock_acquire (&journal_lock);
+  while (commit_wanted
+         || txn_cnt + revoke_cnt + reserved + credits > txn_cap)
+    {
+      if (handle_cnt == 0)
+        commit ();
+      else
+        {
+          commit_wanted = true;
+          cond_wait (&journal_idle, &journal_lock);
+        }
+    }
+  handle_cnt++;
+  reserved += credits;
+  t->journal_credits = credits;
+  lock_release (&journal_lock);
+}
+
+/** Makes sure that the current thread's handle has at least
+   CREDITS credits left, taking what it lacks from those no handle
+   has reserved.  Does not wait: returns false if there are too
+   few, after which an outermost handle may wait for them with
+   journal_restart(). */
+bool
+journal_extend (size_t credits)
+{
+  struct thread *t = thread_current ();
+  size_t need;
+  bool success;
+
+  if (!started)
+    return true;
+  ASSERT (t->journal_depth > 0);
+  if (t->journal_credits >= credits)
+    return true;
+
+  lock_acquire (&journal_lock);
+  need = credits - t->journal_credits;
+  success = (txn_cnt + revoke_cnt + reserved + need
+             <= (t->journal_depth > 1 ? hard_cap : txn_cap));
+  if (success)
+    {
+      reserved += need;
+      t->journal_credits = credits;
+    }
+  lock_release (&journal_lock);
+  return success;
+}
+
+/** Returns true if the current thread's handle is nested in
+   another, so that it can be neither restarted nor made to wait. */
+bool
+journal_nested (void)
+{
+  return thread_current ()->journal_depth > 1;
+}
+
+/** Ends the current thread's handle and begins another with
+   CREDITS credits, so that an operation too large for one
+   transaction goes on in the next.  What the first handle wrote
+   may be committed without what the second one writes.  The
+   handle must not be nested, and, as for journal_begin(), no file
+   system lock may be held. */
+void
+journal_restart (size_t credits)
+{
+  ASSERT (!journal_nested ());
+  journal_end ();
+  journal_begin (credits);
+}
+
+/** Ends the handle begun by the matching journal_begin(), giving
+   back the credits it did not use. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0 || !started)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  if (--handle_cnt == 0)
+    cond_broadcast (&journal_idle, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/** Takes one of T's credits for a sector that its handle adds to
+   the running transaction or revokes in it.  A handle that
+   reserved too few may still take a credit no handle reserved,
+   but never past HARD_CAP: the credits asked for are bounds, not
+   guesses.  Must hold journal_lock. */
+static void
+take_credit (struct thread *t)
+{
+  if (t->journal_credits > 0)
+    {
+      t->journal_credits--;
+      reserved--;
+    }
+  ASSERT (txn_cnt + revoke_cnt + reserved < hard_cap);
+}
+
+/** Writes SIZE bytes from BUFFER at OFFSET within SECTOR, like
+   cache_write_at(), as part of the running transaction if the
+   current thread is in a handle.  The sector then stays pinned in
+   the buffer cache until the transaction is committed.  Adding it
+   to the transaction takes one of the handle's credits. */
+void
+journal_write_at (block_sector_t sector, const void *buffer,
+                  int offset, int size)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  if (t->journal_depth == 0 || !started)
+    {
+      cache_write_at (sector, buffer, offset, size);
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  if (find_sector (txn, txn_cnt, sector) == txn_cnt)
+    {
+      take_credit (t);
+      txn[txn_cnt++] = sector;
+    }
+  if (find_sector (live, live_cnt, sector) == live_cnt)
+    {
+      /* Used for metadata again since it was freed: what this
+         transaction logs for it is to be replayed after all. */
+      live[live_cnt++] = sector;
+      i = find_sector (revoked, revoke_cnt, sector);
+      if (i < revoke_cnt)
+        revoked[i] = revoked[--revoke_cnt];
+    }
+  lock_release (&journal_lock);
+
+  /* No commit can start before the handle ends. */
+  cache_write_pinned_at (sector, buffer, offset, size);
+}
+
+/** Revokes what was logged for the CNT sectors from SECTOR on,
+   which are being freed, so that it is not replayed over what
+   they hold once they are used again.  Each sector revoked takes
+   one of the current thread's credits; sectors not logged since
+   the last checkpoint need none. */
+void
+journal_revoke (block_sector_t sector, size_t cnt)
+{
+  struct thread *t = thread_current ();
+  size_t i = 0;
+
+  if (!started)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (i < live_cnt)
+    if (live[i] - sector < cnt)
+      {
+        ASSERT (t->journal_depth > 0);
+        take_credit (t);
+        revoked[revoke_cnt++] = live[i];
+        live[i] = live[--live_cnt];
+      }
+    else
+      i++;
+  lock_release (&journal_lock);
+}
+
+/** Writes SECTOR from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes, like journal_write_at(). */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  journal_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/** Commits the running transaction and checkpoints the log, so
+   that nothing is left to replay.  Must not be called in a
+   handle. */
+void
+journal_sync (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+  if (!started)
+    return;
+
+  lock_acquire (&journal_lock);
+  commit_when_idle ();
+  if (head != tail)
+    checkpoint ();
+  lock_release (&journal_lock);
+}
+
+/** Commits the running transaction every COMMIT_INTERVAL ticks,
+   grouping the operations done meanwhile, and checkpoints the log
+   every CHECKPOINT_INTERVAL commits, so that little is left to
+   replay after a crash. */
+static void
+journal_daemon (void *aux UNUSED)
+{
+  unsigned i;
+
+  for (i = 1; ; i++)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      lock_acquire (&journal_lock);
+      if (txn_cnt > 0 || revoke_cnt > 0)
+        commit_when_idle ();
+      if (i % CHECKPOINT_INTERVAL == 0 && head != tail && txn_cnt == 0)
+        checkpoint ();
+      lock_release (&journal_lock);
+    }
+}
+
+/** Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %lld transactions committed, %lld sectors logged, "
+          "%lld revoked, %lld checkpoints, %lld transactions replayed\n",
+          commit_cnt, logged_cnt, revoked_cnt, checkpoint_cnt, replay_cnt);
+}
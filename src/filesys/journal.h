@@ -0,0 +1,24 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/** Sectors set aside for the journal, from JOURNAL_SECTOR on: a
+   header, then the log. */
+#define JOURNAL_SECTORS 128
+
+void journal_init (bool format);
+void journal_begin (size_t credits);
+bool journal_extend (size_t credits);
+bool journal_nested (void);
+void journal_restart (size_t credits);
+void journal_end (void);
+void journal_write (block_sector_t, const void *);
+void journal_write_at (block_sector_t, const void *, int offset, int size);
+void journal_revoke (block_sector_t, size_t cnt);
+void journal_sync (void);
+void journal_print_stats (void);
+
+#endif /**< filesys/journal.h */
@@ -0,0 +1,30 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/** Number of buckets in a page fault latency histogram.
+   Bucket 0 counts faults that took fewer than
+   2**RUSAGE_HIST_SHIFT TSC cycles, bucket I > 0 those that took
+   up to twice as long as bucket I - 1, and the last bucket
+   everything longer. */
+#define RUSAGE_HIST_BUCKETS 16
+#define RUSAGE_HIST_SHIFT 10
+
+/** Virtual memory usage of a process, returned by getrusage(). */
+struct rusage
+  {
+    uint32_t minor_faults;      /**< Faults resolved without I/O. */
+    uint32_t major_faults;      /**< Faults that read from swap or a file. */
+    uint32_t swap_ins;          /**< Pages read from swap. */
+    uint32_t file_ins;          /**< Pages read from files. */
+    uint32_t swap_outs;         /**< Pages written to swap on eviction. */
+    uint32_t file_outs;         /**< Mapped file pages written back. */
+    uint32_t evictions;         /**< Pages evicted. */
+    uint32_t rss;               /**< Pages resident now. */
+    uint32_t max_rss;           /**< Most pages resident at once. */
+    uint32_t swapped;           /**< Pages in swap now. */
+    uint32_t fault_cycles[RUSAGE_HIST_BUCKETS]; /**< Fault latencies. */
+  };
+
+#endif /**< lib/rusage.h */
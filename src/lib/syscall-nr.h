@@ -28,7 +28,19 @@ enum
     SYS_MKDIR,                  /**< Create a directory. */
     SYS_READDIR,                /**< Reads a directory entry. */
     SYS_ISDIR,                  /**< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /**< Returns the inode number for a fd. */
+    SYS_INUMBER,                /**< Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /**< Clone the current process. */
+    SYS_MADVISE,                /**< Give hints on memory access. */
+    SYS_GETRUSAGE               /**< Report virtual memory usage. */
   };
 
+/** Access hints for SYS_MADVISE. */
+#define MADV_NORMAL     0       /**< No special treatment. */
+#define MADV_RANDOM     1       /**< Random access: no read-ahead. */
+#define MADV_SEQUENTIAL 2       /**< Sequential access: read ahead, reclaim behind. */
+#define MADV_WILLNEED   3       /**< Access soon: load the pages now. */
+#define MADV_DONTNEED   4       /**< No access soon: drop the pages. */
+
 #endif /**< lib/syscall-nr.h */
@@ -2,7 +2,10 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <rusage.h>
+#include <syscall-nr.h>
 
 /** Process identifier. */
 typedef int pid_t;
@@ -45,4 +48,9 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/** Extensions. */
+pid_t fork (void);
+int madvise (void *addr, size_t length, int advice);
+int getrusage (struct rusage *);
+
 #endif /**< lib/user/syscall.h */
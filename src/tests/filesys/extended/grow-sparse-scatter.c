@@ -0,0 +1,74 @@
+/** Writes single bytes into a large sparse file, in scattered
+   order and far enough apart that each lands between two holes,
+   until the file has more extents than one level of extent tree
+   nodes holds.  Checks the bytes and the holes between them,
+   before and after reopening the file, then removes it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WRITE_CNT 1500
+#define STRIDE (11 * 512)
+
+static int order[WRITE_CNT];
+
+static char
+byte_at (int i) 
+{
+  return 'a' + i % 26;
+}
+
+static void
+check_bytes (int fd) 
+{
+  int i;
+
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      char c;
+
+      seek (fd, i * STRIDE);
+      if (read (fd, &c, 1) != 1 || c != byte_at (i))
+        fail ("byte at %d is wrong", i * STRIDE);
+      seek (fd, i * STRIDE + STRIDE / 2);
+      if (i < WRITE_CNT - 1 && (read (fd, &c, 1) != 1 || c != 0))
+        fail ("hole at %d is not zero", i * STRIDE + STRIDE / 2);
+    }
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "sparse";
+  int fd, i;
+
+  for (i = 0; i < WRITE_CNT; i++)
+    order[i] = i;
+  shuffle (order, WRITE_CNT, sizeof *order);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("write %d bytes %d apart", WRITE_CNT, STRIDE);
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      char c = byte_at (order[i]);
+
+      seek (fd, order[i] * STRIDE);
+      if (write (fd, &c, 1) != 1)
+        fail ("write at %d failed", order[i] * STRIDE);
+    }
+  CHECK (filesize (fd) == (WRITE_CNT - 1) * STRIDE + 1,
+         "filesize \"%s\"", file_name);
+  msg ("check \"%s\"", file_name);
+  check_bytes (fd);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\" again", file_name);
+  msg ("check \"%s\"", file_name);
+  check_bytes (fd);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-scatter) begin
+(grow-sparse-scatter) create "sparse"
+(grow-sparse-scatter) open "sparse"
+(grow-sparse-scatter) write 1500 bytes 5632 apart
+(grow-sparse-scatter) filesize "sparse"
+(grow-sparse-scatter) check "sparse"
+(grow-sparse-scatter) close "sparse"
+(grow-sparse-scatter) open "sparse" again
+(grow-sparse-scatter) check "sparse"
+(grow-sparse-scatter) close "sparse"
+(grow-sparse-scatter) remove "sparse"
+(grow-sparse-scatter) end
+EOF
+pass;
@@ -0,0 +1,20 @@
+/** Child process of page-oom.
+   Writes to more pages than fit in memory and swap together,
+   so it must be killed. */
+
+#include "tests/lib.h"
+
+const char *test_name = "child-oom";
+
+#define SIZE (16 * 1024 * 1024)
+static char buf[SIZE];
+
+int
+main (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += 4096)
+    buf[i] = 1;
+  return 0;
+}
@@ -0,0 +1,57 @@
+/** Fills a buffer larger than the user pool, so that part of it is
+   in swap already, then forks a child.  The child checks every
+   page, which faults back in pages whose swap slots it shares with
+   the parent, then overwrites the buffer with its own pattern and
+   checks it again.  Meanwhile the parent's pages are evicted while
+   still shared.  The parent checks that its copy survives all of
+   this. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1536 * 1024)
+#define PAGE_SIZE 4096
+
+static unsigned char buf[SIZE];
+
+/** Byte I of the buffer of the process with the given ID. */
+static unsigned char
+pattern (size_t i, int id) 
+{
+  return (unsigned char) (i % 251 + i / PAGE_SIZE + id);
+}
+
+static void
+check_buf (int id) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != pattern (i, id))
+      fail ("byte %zu is %d, expected %d", i, buf[i], pattern (i, id));
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = pattern (i, 0);
+
+  child = fork ();
+  if (child == 0) 
+    {
+      check_buf (0);
+      for (i = 0; i < SIZE; i++)
+        buf[i] = pattern (i, 1);
+      check_buf (1);
+      exit (0x42);
+    }
+  CHECK (child != PID_ERROR, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf (0);
+  msg ("parent's buffer unchanged");
+}
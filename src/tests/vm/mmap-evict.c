@@ -0,0 +1,50 @@
+/** Writes every byte of a file mapping twice the size of the user
+   pool that the test runs with, so that dirty pages of the mapping
+   have to be evicted to their file.  Unmaps the file, then reads
+   it back with the read system call to verify. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (512 * 1024)
+#define PAGE_SIZE 4096
+
+static char *map = (char *) 0x10000000;
+
+/** Byte I of the file: differs from page to page. */
+static char
+pattern (size_t i)
+{
+  return (char) (i % 251 + i / PAGE_SIZE);
+}
+
+void
+test_main (void)
+{
+  static char buf[PAGE_SIZE];
+  size_t i, j;
+  int handle;
+  mapid_t id;
+
+  CHECK (create ("big", SIZE), "create \"big\"");
+  CHECK ((handle = open ("big")) > 1, "open \"big\"");
+  CHECK ((id = mmap (handle, map)) != MAP_FAILED, "mmap \"big\"");
+
+  msg ("write through mapping");
+  for (i = 0; i < SIZE; i++)
+    map[i] = pattern (i);
+  munmap (id);
+
+  msg ("read back");
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    {
+      if (read (handle, buf, PAGE_SIZE) != PAGE_SIZE)
+        fail ("read of page %zu failed", i / PAGE_SIZE);
+      for (j = 0; j < PAGE_SIZE; j++)
+        if (buf[j] != pattern (i + j))
+          fail ("byte %zu is %d, expected %d",
+                i + j, buf[j], pattern (i + j));
+    }
+  close (handle);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-evict) begin
+(mmap-evict) create "big"
+(mmap-evict) open "big"
+(mmap-evict) mmap "big"
+(mmap-evict) write through mapping
+(mmap-evict) read back
+(mmap-evict) end
+EOF
+pass;
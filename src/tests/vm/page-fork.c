@@ -0,0 +1,64 @@
+/** Fills 1 MB with a pattern, then forks 8 children at once.
+   Each child checks the pattern and rewrites every other page,
+   so the children together touch far more memory than the
+   machine has and shared pages are forced out to swap.  The
+   parent checks that its copy survives all of this. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define PAGE_SIZE 4096
+#define CHILD_CNT 8
+
+static unsigned char buf[SIZE];
+
+static void
+check_buf (void) 
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (unsigned char) (i % 251))
+      fail ("byte %zu is %d, expected %d", i, buf[i], (int) (i % 251));
+}
+
+static void
+child_main (int id) 
+{
+  size_t i;
+
+  check_buf ();
+  for (i = 0; i < SIZE; i += 2 * PAGE_SIZE)
+    buf[i] = (unsigned char) id;
+  for (i = 0; i < SIZE; i += 2 * PAGE_SIZE)
+    if (buf[i] != (unsigned char) id)
+      fail ("child %d: byte %zu lost its write", id, i);
+  exit (id);
+}
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  size_t i;
+  int id;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = (unsigned char) (i % 251);
+
+  for (id = 0; id < CHILD_CNT; id++) 
+    {
+      children[id] = fork ();
+      if (children[id] == 0)
+        child_main (id);
+      CHECK (children[id] != PID_ERROR, "fork child %d", id);
+    }
+
+  for (id = 0; id < CHILD_CNT; id++) 
+    CHECK (wait (children[id]) == id, "wait for child %d", id);
+
+  check_buf ();
+  msg ("parent's buffer unchanged");
+}
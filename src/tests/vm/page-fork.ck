@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) fork child 0
+(page-fork) fork child 1
+(page-fork) fork child 2
+(page-fork) fork child 3
+(page-fork) fork child 4
+(page-fork) fork child 5
+(page-fork) fork child 6
+(page-fork) fork child 7
+(page-fork) wait for child 0
+(page-fork) wait for child 1
+(page-fork) wait for child 2
+(page-fork) wait for child 3
+(page-fork) wait for child 4
+(page-fork) wait for child 5
+(page-fork) wait for child 6
+(page-fork) wait for child 7
+(page-fork) parent's buffer unchanged
+(page-fork) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/** Gives access hints with madvise() and checks that memory
+   keeps its contents or is dropped as the hints say: DONTNEED
+   on zero-filled memory reads back as zeros, DONTNEED on a
+   mapped file writes it back first, and ranges that are not
+   mapped are rejected. */
+
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+#define ACTUAL ((void *) 0x10000000)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  char *start = (char *) ROUND_UP ((uintptr_t) buf, 4096);
+  size_t size = SIZE - 4096;
+  size_t i;
+  int handle;
+  mapid_t map;
+
+  /* Zero-filled memory. */
+  memset (start, 'a', size);
+  CHECK (madvise (start, size, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  for (i = 0; i < size; i++)
+    if (start[i] != 'a')
+      fail ("byte %zu changed after MADV_SEQUENTIAL", i);
+  CHECK (madvise (start, size, MADV_DONTNEED) == 0, "madvise dontneed");
+  for (i = 0; i < size; i++)
+    if (start[i] != 0)
+      fail ("byte %zu not zero after MADV_DONTNEED", i);
+
+  /* Mapped file. */
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_DONTNEED) == 0,
+         "madvise dontneed on mapping");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_WILLNEED) == 0,
+         "madvise willneed on mapping");
+  if (memcmp (ACTUAL, sample, strlen (sample)))
+    fail ("mapping lost data written before MADV_DONTNEED");
+  munmap (map);
+  close (handle);
+
+  /* Bad ranges. */
+  CHECK (madvise (ACTUAL, 4096, MADV_WILLNEED) == -1,
+         "madvise on unmapped memory fails");
+  CHECK (madvise (start + 1, 4096, MADV_WILLNEED) == -1,
+         "madvise on misaligned address fails");
+}
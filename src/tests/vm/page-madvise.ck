@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-madvise) begin
+(page-madvise) madvise sequential
+(page-madvise) madvise dontneed
+(page-madvise) create "sample.txt"
+(page-madvise) open "sample.txt"
+(page-madvise) mmap "sample.txt"
+(page-madvise) madvise dontneed on mapping
+(page-madvise) madvise willneed on mapping
+(page-madvise) madvise on unmapped memory fails
+(page-madvise) madvise on misaligned address fails
+(page-madvise) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+/** Runs a child that runs out of memory and swap, and checks that
+   only the child is killed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  CHECK ((child = exec ("child-oom")) != -1, "exec \"child-oom\"");
+  CHECK (wait (child) == -1, "wait for child-oom");
+}
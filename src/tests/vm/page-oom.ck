@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-oom) begin
+(page-oom) exec "child-oom"
+Out of memory: killing child-oom
+(page-oom) wait for child-oom
+(page-oom) end
+EOF
+pass;
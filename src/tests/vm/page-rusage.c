@@ -0,0 +1,30 @@
+/** Touches pages of a zero-filled buffer and checks that
+   getrusage() counts the faults and the resident pages. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 32
+
+static char buf[PAGES * 4096];
+
+void
+test_main (void)
+{
+  struct rusage before, after;
+  size_t i;
+
+  CHECK (getrusage (&before) == 0, "getrusage");
+  for (i = 0; i < sizeof buf; i += 4096)
+    buf[i] = 1;
+  CHECK (getrusage (&after) == 0, "getrusage after touching %d pages", PAGES);
+
+  if (after.minor_faults + after.major_faults
+      < before.minor_faults + before.major_faults + PAGES - 1)
+    fail ("fewer faults than pages touched");
+  if (after.rss < before.rss + PAGES - 1)
+    fail ("resident set did not grow with the pages touched");
+  if (after.max_rss < after.rss)
+    fail ("maximum resident set below resident set");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rusage) begin
+(page-rusage) getrusage
+(page-rusage) getrusage after touching 32 pages
+(page-rusage) end
+EOF
+pass;
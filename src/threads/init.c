@@ -24,6 +24,7 @@
 #include "threads/thread.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/wset.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -36,6 +37,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,7 +54,7 @@ static bool format_filesys;
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
-static const char *swap_bdev_name;
+static char *swap_bdev_name;
 #endif
 #endif /**< FILESYS */
 
@@ -61,6 +63,12 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pge (void);
+
+/** CR4 bit that enables global pages. */
+#define CR4_PGE 0x00000080
+/** CPUID leaf 1 EDX bit reporting global page support. */
+#define CPUID_PGE 0x00002000
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -70,6 +78,9 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+#ifdef VM
+static void locate_swap_devices (char *names);
+#endif
 #endif
 
 int pintos_init (void) NO_RETURN;
@@ -102,6 +113,7 @@ pintos_init (void)
   paging_init ();
 
   frame_table_init();
+  wset_init();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -229,7 +241,10 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      /* The kernel is mapped the same way in every page
+         directory, so its TLB entries need not be flushed when
+         switching processes. */
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -238,6 +253,25 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Honor PTE_G if the CPU supports global pages.  See [IA32-v3a]
+     3.12 "Translation Lookaside Buffers (TLBs)". */
+  if (cpu_has_pge ())
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
+    }
+}
+
+/** Returns true if the CPU supports global pages, as reported by
+   CPUID leaf 1.  See [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has_pge (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PGE) != 0;
 }
 
 /** Breaks the kernel command line into words and returns them as
@@ -299,6 +333,12 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-bc"))
+        {
+          cache_sector_cnt = atoi (value);
+          if (cache_sector_cnt < 64)
+            PANIC ("buffer cache needs at least 64 sectors");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -311,6 +351,25 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        print_rusage = true;
+      else if (!strcmp (name, "-load"))
+        {
+          if (!strcmp (value, "lazy"))
+            load_policy = LOAD_LAZY;
+          else if (!strcmp (value, "eager"))
+            load_policy = LOAD_EAGER;
+          else if (!strcmp (value, "adaptive"))
+            load_policy = LOAD_ADAPTIVE;
+          else
+            PANIC ("unknown load policy `%s' (use -h for help)", value);
+        }
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fa"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-sl"))
+        stack_limit = (size_t) atoi (value) * 1024;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -425,14 +484,23 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -bc=N              Cache N file system sectors (default 64).\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV[:PRIO][,...]  Use BDEVs for swap instead of all swap\n"
+          "                     partitions; higher PRIO is used first.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rusage            Print memory usage of each process at exit.\n"
+          "  -load=POLICY       Load executables lazily (default), eagerly,\n"
+          "                     or adaptively (eagerly if small).\n"
+#endif
+#ifdef VM
+          "  -fa=N              Load up to N following file pages per page fault.\n"
+          "  -sl=KB             Limit user stacks to KB kB (default 8192).\n"
 #endif
           );
   shutdown_power_off ();
@@ -446,10 +514,54 @@ locate_block_devices (void)
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
+  locate_swap_devices (swap_bdev_name);
 #endif
 }
 
+#ifdef VM
+/** Adds the swap devices named in NAMES, a comma-separated list
+   of BDEV[:PRIO] items, or every swap partition with priority 0
+   if NAMES is null.  The first one also takes the swap role. */
+static void
+locate_swap_devices (char *names)
+{
+  struct block *block;
+
+  if (names != NULL)
+    {
+      char *item, *save_ptr;
+
+      for (item = strtok_r (names, ",", &save_ptr); item != NULL;
+           item = strtok_r (NULL, ",", &save_ptr))
+        {
+          char *prio_ptr;
+          char *name = strtok_r (item, ":", &prio_ptr);
+          char *prio = strtok_r (NULL, "", &prio_ptr);
+
+          block = block_get_by_name (name);
+          if (block == NULL)
+            PANIC ("No such block device \"%s\"", name);
+          printf ("swap: using %s, priority %d\n", name,
+                  prio != NULL ? atoi (prio) : 0);
+          swap_add_device (block, prio != NULL ? atoi (prio) : 0);
+          if (block_get_role (BLOCK_SWAP) == NULL)
+            block_set_role (BLOCK_SWAP, block);
+        }
+    }
+  else
+    {
+      for (block = block_first (); block != NULL; block = block_next (block))
+        if (block_type (block) == BLOCK_SWAP)
+          {
+            printf ("swap: using %s\n", block_name (block));
+            swap_add_device (block, 0);
+            if (block_get_role (BLOCK_SWAP) == NULL)
+              block_set_role (BLOCK_SWAP, block);
+          }
+    }
+}
+#endif
+
 /** Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
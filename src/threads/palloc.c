@@ -149,6 +149,22 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/** Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/** Returns the index of PAGE, which must have been allocated from
+   the user pool, among the pages of the user pool. */
+size_t
+palloc_user_page_no (void *page)
+{
+  ASSERT (page_from_pool (&user_pool, page));
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
 /** Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
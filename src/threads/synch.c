@@ -360,3 +360,110 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
         while (!list_empty(&cond->waiters[i]))
             cond_signal(cond, lock);
 }
+
+/** Initializes RW as an unheld readers-writer lock. */
+void rwlock_init(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_init(&rw->lock);
+    rw->readers = 0;
+    rw->writing = false;
+    rw->writer = NULL;
+    rw->waiting_readers = 0;
+    rw->waiting_writers = 0;
+    sema_init(&rw->read_turn, 0);
+    sema_init(&rw->write_turn, 0);
+}
+
+/** Acquires RW for reading, sleeping while a writer holds it or
+   waits for it.  A thread releasing RW admits waiting threads
+   itself, so a woken thread already holds RW. */
+void rwlock_acquire_read(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+
+    lock_acquire(&rw->lock);
+    if (!rw->writing && rw->waiting_writers == 0)
+    {
+        rw->readers++;
+        lock_release(&rw->lock);
+        return;
+    }
+    rw->waiting_readers++;
+    lock_release(&rw->lock);
+    sema_down(&rw->read_turn);
+}
+
+/** Releases RW, which the current thread holds for reading. */
+void rwlock_release_read(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    lock_acquire(&rw->lock);
+    ASSERT(rw->readers > 0);
+    if (--rw->readers == 0 && rw->waiting_writers > 0)
+    {
+        rw->waiting_writers--;
+        rw->writing = true;
+        sema_up(&rw->write_turn);
+    }
+    lock_release(&rw->lock);
+}
+
+/** Acquires RW for writing, sleeping while anyone else holds it. */
+void rwlock_acquire_write(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(!intr_context());
+    ASSERT(!rwlock_held_for_write(rw));
+
+    lock_acquire(&rw->lock);
+    if (!rw->writing && rw->readers == 0)
+    {
+        rw->writing = true;
+        lock_release(&rw->lock);
+    }
+    else
+    {
+        rw->waiting_writers++;
+        lock_release(&rw->lock);
+        sema_down(&rw->write_turn);
+    }
+    rw->writer = thread_current();
+}
+
+/** Releases RW, which the current thread holds for writing. */
+void rwlock_release_write(struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+    ASSERT(rwlock_held_for_write(rw));
+
+    lock_acquire(&rw->lock);
+    rw->writer = NULL;
+    rw->writing = false;
+    if (rw->waiting_readers > 0)
+    {
+        for (; rw->waiting_readers > 0; rw->waiting_readers--)
+        {
+            rw->readers++;
+            sema_up(&rw->read_turn);
+        }
+    }
+    else if (rw->waiting_writers > 0)
+    {
+        rw->waiting_writers--;
+        rw->writing = true;
+        sema_up(&rw->write_turn);
+    }
+    lock_release(&rw->lock);
+}
+
+/** Returns true if the current thread holds RW for writing. */
+bool rwlock_held_for_write(const struct rwlock *rw)
+{
+    ASSERT(rw != NULL);
+
+    return rw->writer == thread_current();
+}
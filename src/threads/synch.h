@@ -43,6 +43,30 @@ void cond_wait(struct condition *, struct lock *);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/** Readers-writer lock.  Any number of readers or a single
+   writer may hold it at once.  When a writer releases it, the
+   readers waiting for it go first; when the last reader does, a
+   waiting writer goes, and readers arriving while a writer waits
+   queue behind it, so neither side starves. */
+struct rwlock
+{
+    struct lock lock;              /**< Protects the fields below. */
+    unsigned readers;              /**< Readers holding the lock. */
+    bool writing;                  /**< Held by a writer? */
+    struct thread *writer;         /**< Writer holding the lock. */
+    unsigned waiting_readers;      /**< Readers waiting on READ_TURN. */
+    unsigned waiting_writers;      /**< Writers waiting on WRITE_TURN. */
+    struct semaphore read_turn;    /**< Upped for each admitted reader. */
+    struct semaphore write_turn;   /**< Upped for each admitted writer. */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_held_for_write(const struct rwlock *);
+
 /** Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -2,7 +2,9 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
+#include <rusage.h>
 #include <stdint.h>
 #include "threads/synch.h"
 
@@ -121,8 +123,40 @@ struct thread
     struct semaphore s;
     struct file *exe;
 
-    /** Supplemental page table of the process. */
-    struct list sup_page_table;
+    /** Memory areas of the process sorted by address, and the
+        last one found by a lookup. */
+    struct list vm_areas;
+    struct vm_area *vm_area_cache;
+
+    /** Supplemental page table: state of the pages loaded so far. */
+    struct hash sup_page_table;
+
+    /** Next mmap() mapping id to hand out. */
+    int next_mapid;
+
+    /** User stack pointer saved on entry to a system call, for
+        stack growth faults taken in the kernel. */
+    void *user_esp;
+
+    /** Page faults, paging I/O and resident pages of the process. */
+    struct rusage rusage;
+
+    /** Working set estimate and admission state (vm/wset.c). */
+    size_t ws_estimate;        /**< Estimate as of window ws_window. */
+    size_t ws_referenced;      /**< Pages seen referenced in ws_window. */
+    unsigned ws_window;        /**< Window last sampled in. */
+    unsigned ws_checked;       /**< Window last checked for overcommit. */
+    bool ws_active;            /**< Competing for frames? */
+    struct list_elem ws_elem;  /**< Element in the active processes. */
+
+    /** Chosen to be killed when memory and swap ran out. */
+    bool oom_killed;
+
+    /** Nesting depth of the file system journal handles held. */
+    int journal_depth;
+
+    /** Credits left to the outermost of those handles. */
+    size_t journal_credits;
 
     /* Owned by thread.c. */
     unsigned magic; /**< Detects stack overflow. */
@@ -8,16 +8,34 @@
 #include "vm/frame.h"
 #include "userprog/syscall.h"
 #include "vm/swap.h"
+#include "vm/wset.h"
 #include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
 
 /** Number of page faults processed. */
 static long long page_fault_cnt;
 
+/** Number of pages loaded ahead of a fault by fault-around. */
+static long long fault_around_cnt;
+
+/** Number of stack pages mapped ahead of a stack growth fault. */
+static long long stack_prefault_cnt;
+
 static void kill(struct intr_frame *);
 static void page_fault(struct intr_frame *);
-
-/** load() helpers. */
-static bool install_page(void *upage, void *kpage, bool writable);
+static void resolve_fault(struct intr_frame *, void *fault_addr,
+                          bool not_present, bool write, bool user);
+static void account_fault(struct rusage *, uint64_t cycles, bool major);
+
+/** Reads the CPU's time-stamp counter.
+   See [IA32-v2b] "RDTSC--Read Time-Stamp Counter". */
+static inline uint64_t
+rdtsc(void)
+{
+    uint64_t tsc;
+    asm volatile("rdtsc" : "=A"(tsc));
+    return tsc;
+}
 
 /** Registers handlers for interrupts that can be caused by user
    programs.
@@ -71,6 +89,8 @@ void exception_init(void)
 void exception_print_stats(void)
 {
     printf("Exception: %lld page faults\n", page_fault_cnt);
+    printf("Fault-around: %lld pages loaded ahead\n", fault_around_cnt);
+    printf("Stack growth: %lld pages mapped ahead\n", stack_prefault_cnt);
 }
 
 /** Handler for an exception (probably) caused by a user process. */
@@ -114,20 +134,6 @@ kill(struct intr_frame *f)
     }
 }
 
-/** Find sup_page_table_entry in sup_page_table list. */
-static struct sup_page_table_entry *find_spte(void *addr)
-{
-    struct list *list = &thread_current()->sup_page_table;
-    struct list_elem *e;
-    for (e = list_begin(list); e != list_end(list); e = list_next(e))
-    {
-        struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, elem);
-        if (addr >= spte->vaddr && addr < spte->vaddr + PGSIZE)
-            return spte;
-    }
-    return NULL;
-}
-
 /** Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -142,9 +148,9 @@ static struct sup_page_table_entry *find_spte(void *addr)
 static void
 page_fault(struct intr_frame *f)
 {
-    // bool not_present; /**< True: not-present page, false: writing r/o page. */
+    bool not_present; /**< True: not-present page, false: writing r/o page. */
     bool write;       /**< True: access was write, false: access was read. */
-    // bool user;        /**< True: access by user, false: access by kernel. */
+    bool user;        /**< True: access by user, false: access by kernel. */
     void *fault_addr; /**< Fault address. */
 
     /* Obtain faulting address, the virtual address that was
@@ -164,71 +170,116 @@ page_fault(struct intr_frame *f)
     page_fault_cnt++;
 
     // /* Determine cause. */
-    // not_present = (f->error_code & PF_P) == 0;
+    not_present = (f->error_code & PF_P) == 0;
     write = (f->error_code & PF_W) != 0;
-    // user = (f->error_code & PF_U) != 0;
+    user = (f->error_code & PF_U) != 0;
 
-    /* If fault address is not from user space, just exit. */
-    if (!is_user_vaddr(fault_addr))
+    /* A process killed for memory exits here.  Under overcommit,
+       it may be suspended here. */
+    if (user && thread_current()->oom_killed)
         exit(-1);
+    if (user)
+        wset_checkpoint();
+
+    /* Resolve the fault, and account its cost to the process as a
+       major fault if it had to read from swap or a file. */
+    struct rusage *usage = &thread_current()->rusage;
+    uint32_t reads = usage->swap_ins + usage->file_ins;
+    uint64_t start = rdtsc();
+    resolve_fault(f, fault_addr, not_present, write, user);
+    account_fault(usage, rdtsc() - start, usage->swap_ins + usage->file_ins != reads);
+}
 
-    struct sup_page_table_entry *spte = find_spte(fault_addr);
+/** Counts a fault that took CYCLES TSC cycles in USAGE. */
+static void
+account_fault(struct rusage *usage, uint64_t cycles, bool major)
+{
+    int bucket = 0;
+    for (cycles >>= RUSAGE_HIST_SHIFT; cycles > 0 && bucket < RUSAGE_HIST_BUCKETS - 1;
+         cycles >>= 1)
+        bucket++;
+    usage->fault_cycles[bucket]++;
+    if (major)
+        usage->major_faults++;
+    else
+        usage->minor_faults++;
+}
 
-    /* If fault address is invalid, just exit. */
-    if (spte == NULL)  exit(-1);
+/** Handles an invalid access that caused page fault F.  A kernel
+   access through one of the userprog/uaccess.h functions resumes
+   at its fixup address, which makes the function fail; any other
+   invalid access terminates the process. */
+static void
+bad_access(struct intr_frame *f, bool user)
+{
+    uintptr_t fixup = user ? 0 : search_ex_table((uintptr_t)f->eip);
+    if (fixup == 0)
+        exit(-1);
+    f->eip = (void (*)(void))fixup;
+}
 
-    /* If attempting to write to unwritable pages, just exit. */
-    if (write && spte->writable == false)  exit(-1);
+/** Makes the access to FAULT_ADDR that caused page fault F
+   succeed when it is retried, or handles it as a bad access if
+   it is invalid. */
+static void
+resolve_fault(struct intr_frame *f, void *fault_addr, bool not_present,
+              bool write, bool user)
+{
+    /* If fault address is not from user space, it is invalid. */
+    if (!is_user_vaddr(fault_addr))
+    {
+        bad_access(f, user);
+        return;
+    }
 
-    /* Get a page of memory. */
-    uint8_t *kpage = frame_alloc(PAL_USER | PAL_ZERO, spte, true);
-    if (kpage == NULL)
-        PANIC("Load failed.");
-    else  spte -> frame = kpage;
+    void *upage = pg_round_down(fault_addr);
+    struct vm_area *area = vm_area_find(fault_addr);
 
-    /* Load a page from swap slot. */
-    if (spte->slot != SWAP_NONE) {
-        swap_in(spte->slot, kpage);
-        spte->slot = SWAP_NONE;
+    /* A fault just below the stack grows it.  Faults in system
+       calls are checked against the stack pointer saved on entry. */
+    if (area == NULL)
+    {
+        void *esp = user ? f->esp : thread_current()->user_esp;
+        area = vm_area_grow_stack(fault_addr, esp);
+        if (area != NULL)
+            stack_prefault_cnt += sup_page_table_prefault_stack(area, upage);
     }
 
-    /* Lazy loading in load_segment. */
-    else if (spte->file != NULL) {
-        /* Load this page. */
-        file_seek(spte->file, spte->file_offset);
-        if (file_read(spte->file, kpage, spte->read_bytes) != (int)spte->read_bytes)
-        {
-            frame_free(kpage);
-            PANIC("Load failed.");
-        }
+    /* If fault address is invalid, or the page is not writable
+       for a write, the access is invalid. */
+    if (area == NULL || (write && area->writable == false))
+    {
+        bad_access(f, user);
+        return;
     }
 
-    /* Add the page to the process's address space. */
-    if (!install_page(spte->vaddr, kpage, spte->writable))
+    /* Writing a page that fork() shares read-only: copy on write.
+       A write to the shared zero frame just loads the page. */
+    if (!not_present && pagedir_get_page(thread_current()->pagedir, upage) != frame_zero())
     {
-        frame_free(kpage);
-        PANIC("Load failed.");
+        struct sup_page_table_entry *spte = sup_page_table_find(upage);
+        if (spte == NULL || !frame_cow(spte))
+            bad_access(f, user);
+        return;
     }
 
-    spte->is_loaded = true;
-    frame_depin(kpage);
-}
-
-/** Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page(void *upage, void *kpage, bool writable)
-{
-    struct thread *t = thread_current();
+    /* Reading a page that is still all zeros: map the zero frame. */
+    if (!write && sup_page_table_map_zero(area, upage))
+        return;
 
-    /* Verify that there's not already a page at that virtual
-       address, then map our page there. */
-    return (pagedir_get_page(t->pagedir, upage) == NULL && pagedir_set_page(t->pagedir, upage, kpage, writable));
+    /* Load the page, and the pages that follow it in the same
+       file-backed area if they are not loaded yet. */
+    struct sup_page_table_entry *spte = sup_page_table_find(upage);
+    bool from_file = (spte == NULL || spte->slot == SWAP_NONE)
+                     && vm_area_read_bytes(area, upage) > 0;
+    if (!sup_page_table_load(area, upage))
+    {
+        bad_access(f, user);
+        return;
+    }
+    if (from_file)
+        fault_around_cnt += sup_page_table_fault_around(area, upage);
+    if (area->advice == MADV_SEQUENTIAL)
+        sup_page_table_reclaim_behind(area, upage);
 }
+
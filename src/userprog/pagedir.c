@@ -8,6 +8,7 @@
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /** Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -151,7 +152,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -179,7 +180,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -208,13 +209,79 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/** Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  Clearing it lets processes share a frame until
+   one of them writes to it. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else 
+        {
+          *pte &= ~(uint32_t) PTE_W; 
+          invalidate_page (pd, vpage);
+        }
+    }
+}
+
+/** Initializes BATCH to hold no pages. */
+void
+tlb_batch_init (struct tlb_batch *batch)
+{
+  batch->cnt = 0;
+}
+
+/** Clears the accessed bit in the PTE for virtual page VPAGE in
+   PD like pagedir_set_accessed(), but leaves the TLB entry to
+   be invalidated by tlb_batch_flush() on BATCH.  Until then the
+   CPU may use the page without setting the bit again, which
+   only makes the page look idle for a little longer. */
+void
+pagedir_clear_accessed_batched (uint32_t *pd, const void *vpage,
+                                struct tlb_batch *batch)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL && (*pte & PTE_A) != 0)
+    {
+      *pte &= ~(uint32_t) PTE_A;
+      if (active_pd () == pd)
+        {
+          if (batch->cnt < TLB_BATCH_MAX)
+            batch->pages[batch->cnt] = vpage;
+          batch->cnt++;
+        }
+    }
+}
+
+/** Invalidates the TLB entries of the pages queued in BATCH,
+   one by one if there are few of them, otherwise by reloading
+   CR3, and empties BATCH. */
+void
+tlb_batch_flush (struct tlb_batch *batch)
+{
+  if (batch->cnt > TLB_BATCH_MAX)
+    invalidate_pagedir (active_pd ());
+  else
+    {
+      size_t i;
+      for (i = 0; i < batch->cnt; i++)
+        invalidate_page (active_pd (), batch->pages[i]);
+    }
+  batch->cnt = 0;
+}
+
 /** Loads page directory PD into the CPU's page directory base
-   register. */
+   register.  Kernel mappings are global, so they stay in the
+   TLB; only user translations are flushed. */
 void
 pagedir_activate (uint32_t *pd) 
 {
@@ -260,3 +327,13 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/** Invalidates the TLB entry for virtual page VPAGE if PD is the
+   active page directory, leaving the rest of the TLB intact.
+   See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage)
+{
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
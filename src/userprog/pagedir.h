@@ -2,8 +2,21 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/** Maximum number of pages a tlb_batch invalidates one by one;
+   beyond this the whole TLB is flushed instead. */
+#define TLB_BATCH_MAX 16
+
+/** TLB entries of the active page directory to invalidate
+   together, after a sweep over many pages. */
+struct tlb_batch
+  {
+    size_t cnt;                         /**< Pages queued, may exceed TLB_BATCH_MAX. */
+    const void *pages[TLB_BATCH_MAX];   /**< First TLB_BATCH_MAX pages queued. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -13,6 +26,12 @@ bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 void pagedir_activate (uint32_t *pd);
 
+void tlb_batch_init (struct tlb_batch *);
+void pagedir_clear_accessed_batched (uint32_t *pd, const void *upage,
+                                     struct tlb_batch *);
+void tlb_batch_flush (struct tlb_batch *);
+
 #endif /**< userprog/pagedir.h */
@@ -20,8 +20,11 @@
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/wset.h"
+#include "userprog/syscall.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func fork_process NO_RETURN;
 static bool load(const char *file_name, char *cmdline, void (**eip)(void), void **esp);
 
 /* a struct to pass arguments to start_process */
@@ -112,14 +115,14 @@ start_process(void *argss)
     memset(child->all_files, 0, sizeof(child->all_files));
     sema_init(&child->s, 0);
     child->exe = NULL;
-    sup_page_table_init(&child->sup_page_table);
 
     /* Initialize interrupt frame and load executable. */
     memset(&if_, 0, sizeof if_);
     if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
-    success = load(thread_current()->name, cmdline, &if_.eip, &if_.esp);
+    success = sup_page_table_init()
+              && load(thread_current()->name, cmdline, &if_.eip, &if_.esp);
     ((struct args *)argss)->success = (int)success + 2;
 
     /* Unblock its parent process to inform it the load status */
@@ -137,6 +140,8 @@ start_process(void *argss)
     if (!success)
         thread_exit();
 
+    wset_admit();
+
     /* Start the user process by simulating a return from an
        interrupt, implemented by intr_exit (in
        threads/intr-stubs.S).  Because intr_exit takes all of its
@@ -147,6 +152,126 @@ start_process(void *argss)
     NOT_REACHED();
 }
 
+/* a struct to pass the parent's state to fork_process */
+struct fork_args
+{
+    struct thread *parent;
+    struct intr_frame if_;
+    struct semaphore done;
+    bool success;
+};
+
+/** Clones the current process.  The child returns to user mode
+   from the parent's interrupt frame F, with 0 as the result of
+   the system call.  Returns the child's thread id, or TID_ERROR
+   if the child cannot be created. */
+tid_t process_fork(struct intr_frame *f)
+{
+    struct fork_args *args = malloc(sizeof(struct fork_args));
+    if (args == NULL)
+        return TID_ERROR;
+    args->parent = thread_current();
+    memcpy(&args->if_, f, sizeof args->if_);
+    sema_init(&args->done, 0);
+    args->success = false;
+
+    /* Wait for the child to copy our address space. */
+    tid_t tid = thread_create(thread_name(), PRI_DEFAULT + 5, fork_process, args);
+    if (tid != TID_ERROR)
+    {
+        sema_down(&args->done);
+        if (!args->success)
+            tid = TID_ERROR;
+    }
+    free(args);
+
+    return tid;
+}
+
+/** Gives CHILD, the running thread, a copy of PARENT's address
+   space and open files.  Pages are shared copy-on-write. */
+static bool
+copy_process(struct thread *parent, struct thread *child)
+{
+    child->pagedir = pagedir_create();
+    if (child->pagedir == NULL)
+        return false;
+    process_activate();
+
+    for (int fd = 0; fd < MAX_FD; fd++)
+        if (parent->all_files[fd] != NULL)
+        {
+            child->all_files[fd] = file_duplicate(parent->all_files[fd]);
+            if (child->all_files[fd] == NULL)
+                return false;
+        }
+
+    if (parent->exe != NULL)
+    {
+        child->exe = file_duplicate(parent->exe);
+        if (child->exe == NULL)
+            return false;
+    }
+
+    if (!sup_page_table_copy(parent))
+        return false;
+
+    /* Lazily loaded segments must read from the child's own
+       executable, which stays open after the parent exits. */
+    struct list_elem *e;
+    for (e = list_begin(&child->vm_areas); e != list_end(&child->vm_areas);
+         e = list_next(e))
+    {
+        struct vm_area *area = list_entry(e, struct vm_area, elem);
+        if (area->file == parent->exe)
+            area->file = child->exe;
+    }
+    return true;
+}
+
+/** A thread function that copies the parent process and starts
+   the copy running. */
+static void
+fork_process(void *args_)
+{
+    struct fork_args *args = args_;
+    struct thread *parent = args->parent;
+    struct intr_frame if_;
+
+    /* Initialize information of child process */
+    struct thread *child = thread_current();
+    child->parent = parent->tid;
+    child->exit_status = -1;
+    memset(child->all_files, 0, sizeof(child->all_files));
+    sema_init(&child->s, 0);
+    child->exe = NULL;
+
+    /* The child sees fork() return 0. */
+    memcpy(&if_, &args->if_, sizeof if_);
+    if_.eax = 0;
+
+    /* ARGS belongs to the parent once it is woken up.  A child
+       that fails to start is no child of the parent, which
+       already sees the failure as TID_ERROR, so it leaves no
+       status in the parent's dead_children. */
+    bool success = sup_page_table_init() && copy_process(parent, child);
+    if (!success)
+        child->parent = TID_ERROR;
+    args->success = success;
+    sema_up(&args->done);
+
+    /* return to normal priority */
+    thread_set_priority(PRI_DEFAULT);
+
+    if (!success)
+        exit(-1);
+
+    wset_admit();
+
+    asm volatile("movl %0, %%esp; jmp intr_exit" : : "g"(&if_) : "memory");
+    NOT_REACHED();
+}
+
 /* Find a child according to its tid in list dead_children */
 static struct exec_info *find_child(struct list *l, tid_t child_tid)
 {
@@ -183,8 +308,11 @@ int process_wait(tid_t child_tid)
         /** check if it is a live child from other family */
         if (child->parent != thread_tid())
             return -1;
-        /** Now, we guarantee that it's our own child. */
+        /** Now, we guarantee that it's our own child.  Let others
+            have our frames while we wait. */
+        wset_leave();
         sema_down(&child->s);
+        wset_rejoin();
         child_info = find_child(&thread_current()->dead_children, child_tid);
     }
     /** Its child has already dead now. */
@@ -194,6 +322,39 @@ int process_wait(tid_t child_tid)
     return val;
 }
 
+/** How load() brings in the segments of executables. */
+enum load_policy load_policy = LOAD_LAZY;
+
+/** Largest total size of the file contents of an executable's
+   segments that LOAD_ADAPTIVE loads eagerly.  Below this, the
+   faults of a lazy start cost more than reading pages that the
+   program may never touch. */
+#define EAGER_LOAD_LIMIT (64 * 1024)
+
+/** Whether to print the virtual memory usage of each process
+   when it exits ("-rusage"). */
+bool print_rusage;
+
+/** Prints the virtual memory usage of process T. */
+static void
+rusage_print(struct thread *t)
+{
+    const struct rusage *u = &t->rusage;
+    printf("%s: faults %"PRIu32" minor, %"PRIu32" major; "
+           "in %"PRIu32" swap, %"PRIu32" file; out %"PRIu32" swap, %"PRIu32" file; "
+           "%"PRIu32" evicted; rss %"PRIu32", max %"PRIu32" pages\n",
+           t->name, u->minor_faults, u->major_faults, u->swap_ins, u->file_ins,
+           u->swap_outs, u->file_outs, u->evictions, u->rss, u->max_rss);
+    printf("%s: fault cycles", t->name);
+    for (int i = 0; i < RUSAGE_HIST_BUCKETS - 1; i++)
+        if (u->fault_cycles[i] != 0)
+            printf(" <%lu:%"PRIu32, 1UL << (RUSAGE_HIST_SHIFT + i), u->fault_cycles[i]);
+    if (u->fault_cycles[RUSAGE_HIST_BUCKETS - 1] != 0)
+        printf(" >=%lu:%"PRIu32, 1UL << (RUSAGE_HIST_SHIFT + RUSAGE_HIST_BUCKETS - 2),
+               u->fault_cycles[RUSAGE_HIST_BUCKETS - 1]);
+    printf("\n");
+}
+
 /** Free the current process's resources. */
 void process_exit(void)
 {
@@ -202,6 +363,7 @@ void process_exit(void)
 
     /* print termination messages */
     printf("%s: exit(%d)\n", cur->name, cur->exit_status);
+    wset_leave();
 
     file_close(cur->exe);
     cur->exe = NULL;
@@ -211,6 +373,15 @@ void process_exit(void)
     pd = cur->pagedir;
     if (pd != NULL)
     {
+        if (print_rusage)
+            rusage_print(cur);
+
+        /* Release frames and swap slots while the page directory
+           is still set: mapped files are written back and frames
+           shared with forked processes are checked for dirty pages
+           through every sharer's page directory. */
+        sup_page_table_destroy();
+
         /* Correct ordering here is crucial.  We must set
            cur->pagedir to NULL before switching page directories,
            so that a timer interrupt can't switch back to the
@@ -219,19 +390,6 @@ void process_exit(void)
            directory, or our active page directory will be one
            that's been freed (and cleared). */
         cur->pagedir = NULL;
-
-        while (!list_empty(&cur->sup_page_table))
-        {
-            struct list_elem *e = list_pop_front(&cur->sup_page_table);
-            struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, elem);
-            if (spte->is_loaded) {
-                if (spte->slot == SWAP_NONE)
-                    frame_free(spte->frame);
-                else  swap_set(spte->slot);
-            }
-            free(spte);
-        }
-
         pagedir_activate(NULL);
         pagedir_destroy(pd);
     }
@@ -331,6 +489,7 @@ bool load(const char *file_name, char *cmdline, void (**eip)(void), void **esp)
     struct Elf32_Ehdr ehdr;
     struct file *file = NULL;
     off_t file_ofs;
+    uint32_t file_bytes = 0;
     bool success = false;
     int i;
 
@@ -408,6 +567,7 @@ bool load(const char *file_name, char *cmdline, void (**eip)(void), void **esp)
                 if (!load_segment(file, file_page, (void *)mem_page,
                                   read_bytes, zero_bytes, writable))
                     goto done;
+                file_bytes += read_bytes;
             }
             else
                 goto done;
@@ -415,6 +575,21 @@ bool load(const char *file_name, char *cmdline, void (**eip)(void), void **esp)
         }
     }
 
+    /* Read in the segments now rather than page by page on faults.
+       Running out of frames here is not an error: the rest of the
+       pages are still loaded on demand. */
+    if (load_policy == LOAD_EAGER
+        || (load_policy == LOAD_ADAPTIVE && file_bytes <= EAGER_LOAD_LIMIT))
+    {
+        struct list_elem *e;
+        for (e = list_begin(&t->vm_areas); e != list_end(&t->vm_areas); e = list_next(e))
+        {
+            struct vm_area *area = list_entry(e, struct vm_area, elem);
+            if (area->file == file)
+                sup_page_table_populate(area);
+        }
+    }
+
     /* Divide command line. */
     char **argv = palloc_get_page(0);
     char *token, *save_ptr;
@@ -535,38 +710,10 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(ofs % PGSIZE == 0);
 
-    file_seek(file, ofs);
-    while (read_bytes > 0 || zero_bytes > 0)
-    {
-        /* Calculate how to fill this page.
-           We will read PAGE_READ_BYTES bytes from FILE
-           and zero the final PAGE_ZERO_BYTES bytes. */
-        size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-        size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-        /* For lazy loading, we just record relevant information in 
-           supplemental page table, but not actually load the page. */
-        struct sup_page_table_entry *spte = malloc(sizeof(struct sup_page_table_entry));
-        if (spte == NULL)
-            return false;
-        spte->vaddr = upage;
-        spte->is_loaded = false;
-        spte->file = file;
-        spte->file_offset = ofs;
-        spte->read_bytes = page_read_bytes;
-        spte->zero_bytes = page_zero_bytes;
-        spte->writable = writable;
-        spte->frame = NULL;
-        spte->slot = SWAP_NONE;
-        list_push_back(&thread_current()->sup_page_table, &spte->elem);
-
-        /* Advance. */
-        read_bytes -= page_read_bytes;
-        zero_bytes -= page_zero_bytes;
-        upage += PGSIZE;
-        ofs += PGSIZE;
-    }
-    return true;
+    /* For lazy loading, we just record the segment as an area of
+       the process, but not actually load its pages. */
+    return vm_area_create(upage, read_bytes + zero_bytes, file, ofs,
+                          read_bytes, writable) != NULL;
 }
 
 /** Create a minimal stack by mapping a zeroed page at the top of
@@ -574,19 +721,10 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack(void **esp)
 {
-    /* For lazy loading, we just record relevant information in 
-       supplemental page table, but not actually load the page. */
-    struct sup_page_table_entry *spte = malloc(sizeof(struct sup_page_table_entry));
-    if (spte == NULL)
+    /* For lazy loading, we just record the stack page as an area
+       of the process, but not actually load it. */
+    if (vm_area_create(((uint8_t *)PHYS_BASE) - PGSIZE, PGSIZE, NULL, 0, 0, true) == NULL)
         return false;
-
-    spte->vaddr = ((uint8_t *)PHYS_BASE) - PGSIZE;
-    spte->is_loaded = false;
-    spte->file = NULL;
-    spte->writable = true;
-    spte->frame = NULL;
-    spte->slot = SWAP_NONE;
-    list_push_back(&thread_current()->sup_page_table, &spte->elem);
     *esp = PHYS_BASE;
     return true;
 }
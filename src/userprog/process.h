@@ -2,10 +2,24 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include "threads/interrupt.h"
 
 tid_t process_execute (const char *cmdline);
+tid_t process_fork (struct intr_frame *);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
+extern bool print_rusage;
+
+/** How executables are loaded ("-load=POLICY"). */
+enum load_policy
+  {
+    LOAD_LAZY,                  /**< Page by page on faults. */
+    LOAD_EAGER,                 /**< Whole segments at exec time. */
+    LOAD_ADAPTIVE               /**< Eagerly if small, otherwise lazily. */
+  };
+
+extern enum load_policy load_policy;
+
 #endif /**< userprog/process.h */
@@ -1,23 +1,31 @@
 #include "userprog/syscall.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
 #include <stdio.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "vm/page.h"
 
 static void syscall_handler(struct intr_frame *f);
 static void close(int fd);
-static void assert_pointer(void *pointer);
+static uint32_t get_arg(struct intr_frame *f, int i);
+static char *copy_in_string(const char *ustr);
 
 static int next_fd = 2;
 
+/** Largest piece of a user buffer pinned at once by read() and
+   write(), so that one call cannot pin down all of user memory. */
+#define USER_CHUNK (64 * PGSIZE)
+
 void syscall_init(void)
 {
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
@@ -134,34 +142,76 @@ static int filesize(int fd)
 /** Read from a file. */
 static int read(int fd, void *buffer, unsigned size)
 {
-    if (fd == 0)
+    struct file *s = NULL;
+    if (fd != 0)
     {
-        for (unsigned int i = 0; i < size; i++)
-            *(uint8_t *)(buffer + i) = input_getc();
-        return size;
+        if (!is_valid_fd(fd))
+            return 0;
+        s = thread_current()->all_files[fd];
+        if (s == NULL)
+            return -1;
     }
-    if (!is_valid_fd(fd))
-        return 0;
-    struct file *s = thread_current()->all_files[fd];
-    if (s == NULL)
-        return -1;
-    return file_read(s, buffer, size);
+
+    /* Read into one pinned piece of the buffer at a time, so that
+       the file system never faults on it. */
+    unsigned done = 0;
+    while (done < size)
+    {
+        void *chunk = buffer + done;
+        unsigned chunk_size = size - done < USER_CHUNK ? size - done : USER_CHUNK;
+        if (!sup_page_table_pin(chunk, chunk_size, true))
+            exit(-1);
+
+        unsigned n = chunk_size;
+        if (s == NULL)
+            for (unsigned int i = 0; i < chunk_size; i++)
+                *(uint8_t *)(chunk + i) = input_getc();
+        else
+            n = file_read(s, chunk, chunk_size);
+
+        sup_page_table_unpin(chunk, chunk_size);
+        done += n;
+        if (n < chunk_size)
+            break;
+    }
+    return done;
 }
 
 /** Write to a file. */
 static int write(int fd, const void *buffer, unsigned size)
 {
-    if (fd == 1)
+    struct file *s = NULL;
+    if (fd != 1)
     {
-        putbuf(buffer, size);
-        return size;
+        if (!is_valid_fd(fd))
+            return 0;
+        s = thread_current()->all_files[fd];
+        if (s == NULL)
+            return -1;
     }
-    if (!is_valid_fd(fd))
-        return 0;
-    struct file *s = thread_current()->all_files[fd];
-    if (s == NULL)
-        return -1;
-    return file_write(s, buffer, size);
+
+    /* Write from one pinned piece of the buffer at a time, so that
+       the file system never faults on it. */
+    unsigned done = 0;
+    while (done < size)
+    {
+        const void *chunk = buffer + done;
+        unsigned chunk_size = size - done < USER_CHUNK ? size - done : USER_CHUNK;
+        if (!sup_page_table_pin(chunk, chunk_size, false))
+            exit(-1);
+
+        unsigned n = chunk_size;
+        if (s == NULL)
+            putbuf(chunk, chunk_size);
+        else
+            n = file_write(s, chunk, chunk_size);
+
+        sup_page_table_unpin(chunk, chunk_size);
+        done += n;
+        if (n < chunk_size)
+            break;
+    }
+    return done;
 }
 
 /** Change position in a file. */
@@ -182,6 +232,37 @@ static unsigned tell(int fd)
     return file_tell(s);
 }
 
+/** Map a file into memory. */
+static int mmap(int fd, void *addr)
+{
+    if (fd < 2 || !is_valid_fd(fd))
+        return -1;
+    struct file *s = thread_current()->all_files[fd];
+    if (s == NULL)
+        return -1;
+    return sup_page_table_mmap(s, addr);
+}
+
+/** Remove a memory mapping. */
+static void munmap(int mapid)
+{
+    sup_page_table_munmap(mapid);
+}
+
+/** Give a hint on how a range of memory will be accessed. */
+static int madvise(void *addr, unsigned length, int advice)
+{
+    return sup_page_table_madvise(addr, length, advice);
+}
+
+/** Report the virtual memory usage of this process. */
+static int getrusage(struct rusage *usage)
+{
+    if (!copy_to_user(usage, &thread_current()->rusage, sizeof *usage))
+        exit(-1);
+    return 0;
+}
+
 /** Close a file. */
 static void close(int fd)
 {
@@ -197,22 +278,25 @@ static void close(int fd)
 static void
 syscall_handler(struct intr_frame *f)
 {
-    assert_pointer(f->esp);
-    uint32_t syscall_num = *(uint32_t *)(f->esp);
+    thread_current()->user_esp = f->esp;
+    if (thread_current()->oom_killed)
+        exit(-1);
+    uint32_t syscall_num = get_arg(f, 0);
     uint32_t first_arg, second_arg, third_arg;
     uint32_t value = 0;
+    char *name;
 
     switch (syscall_num)
     {
     case SYS_READ:
     case SYS_WRITE:
-        assert_pointer(f->esp + 12);
-        third_arg = *(uint32_t *)(f->esp + 12);
+    case SYS_MADVISE:
+        third_arg = get_arg(f, 3);
 
     case SYS_SEEK:
     case SYS_CREATE:
-        assert_pointer(f->esp + 8);
-        second_arg = *(uint32_t *)(f->esp + 8);
+    case SYS_MMAP:
+        second_arg = get_arg(f, 2);
 
     case SYS_TELL:
     case SYS_CLOSE:
@@ -222,8 +306,9 @@ syscall_handler(struct intr_frame *f)
     case SYS_EXEC:
     case SYS_WAIT:
     case SYS_REMOVE:
-        assert_pointer(f->esp + 4);
-        first_arg = *(uint32_t *)(f->esp + 4);
+    case SYS_MUNMAP:
+    case SYS_GETRUSAGE:
+        first_arg = get_arg(f, 1);
     }
 
     switch (syscall_num)
@@ -237,8 +322,9 @@ syscall_handler(struct intr_frame *f)
         break;
 
     case SYS_EXEC: /**< Start another process. */
-        assert_pointer((void *)first_arg);
-        value = (uint32_t)exec((char *)first_arg);
+        name = copy_in_string((const char *)first_arg);
+        value = (uint32_t)(name != NULL ? exec(name) : TID_ERROR);
+        palloc_free_page(name);
         break;
 
     case SYS_WAIT: /**< Wait for a child process to die. */
@@ -246,18 +332,21 @@ syscall_handler(struct intr_frame *f)
         break;
 
     case SYS_CREATE: /**< Create a file. */
-        assert_pointer((void *)first_arg);
-        value = (uint32_t)create((char *)first_arg, (unsigned int)second_arg);
+        name = copy_in_string((const char *)first_arg);
+        value = (uint32_t)create(name, (unsigned int)second_arg);
+        palloc_free_page(name);
         break;
 
     case SYS_REMOVE: /**< Delete a file. */
-        assert_pointer((void *)first_arg);
-        value = (uint32_t)remove((char *)first_arg);
+        name = copy_in_string((const char *)first_arg);
+        value = (uint32_t)remove(name);
+        palloc_free_page(name);
         break;
 
     case SYS_OPEN: /**< Open a file. */
-        assert_pointer((void *)first_arg);
-        value = (uint32_t)open((char *)first_arg);
+        name = copy_in_string((const char *)first_arg);
+        value = (uint32_t)open(name);
+        palloc_free_page(name);
         break;
 
     case SYS_FILESIZE: /**< Obtain a file's size. */
@@ -265,12 +354,10 @@ syscall_handler(struct intr_frame *f)
         break;
 
     case SYS_READ: /**< Read from a file. */
-        assert_pointer((void *)second_arg);
         value = (uint32_t)read((int)first_arg, (void *)second_arg, (unsigned int)third_arg);
         break;
 
     case SYS_WRITE: /**< Write to a file. */
-        assert_pointer((void *)second_arg);
         value = (uint32_t)write((int)first_arg, (void *)second_arg, (unsigned int)third_arg);
         break;
 
@@ -285,27 +372,62 @@ syscall_handler(struct intr_frame *f)
     case SYS_CLOSE: /**< Close a file. */
         close((int)first_arg);
         break;
+
+    case SYS_MMAP: /**< Map a file into memory. */
+        value = (uint32_t)mmap((int)first_arg, (void *)second_arg);
+        break;
+
+    case SYS_MUNMAP: /**< Remove a memory mapping. */
+        munmap((int)first_arg);
+        break;
+
+    case SYS_FORK: /**< Clone the current process. */
+        value = (uint32_t)process_fork(f);
+        break;
+
+    case SYS_MADVISE: /**< Give hints on memory access. */
+        value = (uint32_t)madvise((void *)first_arg, (unsigned int)second_arg, (int)third_arg);
+        break;
+
+    case SYS_GETRUSAGE: /**< Report virtual memory usage. */
+        value = (uint32_t)getrusage((struct rusage *)first_arg);
+        break;
     }
 
     f->eax = value;
 }
 
-/** Check whether a pointer is valid. */
-static bool is_valid_ptr(void *pointer)
+/** Fetch the Ith 32-bit word of the system call frame on the user
+    stack: the system call number for I = 0, then its arguments.
+    Exit the process if it is not readable. */
+static uint32_t get_arg(struct intr_frame *f, int i)
 {
-    if (is_user_vaddr(pointer) == 0)
-        return 0;
-    struct thread *t = thread_current();
-    uint32_t *pd = t->pagedir;
-    if (pagedir_get_page(pd, pointer) == NULL)
-        return 0;
-    return 1;
+    uint32_t value;
+    if (!get_user_u32(&value, (uint32_t *)f->esp + i))
+        exit(-1);
+    return value;
 }
 
-/** Verify whether a pointer is valid. If not, exit the process. */
-static void assert_pointer(void *pointer)
+/** Copy the string at user address USTR into a new page, which
+    the caller frees with palloc_free_page().  Exit the process if
+    the string is not readable.  Returns NULL if the string does
+    not fit in a page or no page is left. */
+static char *copy_in_string(const char *ustr)
 {
-    if (is_valid_ptr(pointer) && is_valid_ptr(pointer + 3))
-        return;
-    exit(-1);
+    char *copy = palloc_get_page(0);
+    if (copy == NULL)
+        return NULL;
+
+    int len = strlcpy_from_user(copy, ustr, PGSIZE);
+    if (len < 0)
+    {
+        palloc_free_page(copy);
+        exit(-1);
+    }
+    if (len >= PGSIZE)
+    {
+        palloc_free_page(copy);
+        return NULL;
+    }
+    return copy;
 }
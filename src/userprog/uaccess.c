@@ -0,0 +1,75 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+
+/** Bounds of the exception table, defined by the linker script. */
+extern const struct ex_table_entry _start_ex_table[], _end_ex_table[];
+
+/** Returns the fixup address of the instruction at INSN if it
+   has an entry in the exception table, otherwise 0. */
+uintptr_t search_ex_table(uintptr_t insn)
+{
+    const struct ex_table_entry *e;
+
+    for (e = _start_ex_table; e < _end_ex_table; e++)
+        if (e->insn == insn)
+            return e->fixup;
+    return 0;
+}
+
+/** Copies SIZE bytes from SRC to DST, where one of them is in
+   user memory.  Returns false if the copy faulted on memory the
+   process cannot access. */
+static bool copy_user(void *dst, const void *src, size_t size)
+{
+    asm volatile("1: rep movsb\n"
+                 "2:\n"
+                 EX_TABLE(1b, 2b)
+                 : "+D"(dst), "+S"(src), "+c"(size) : : "memory");
+    return size == 0;
+}
+
+/** Copies SIZE bytes from user address USRC to DST.  Returns
+   false if the user memory is not readable. */
+bool copy_from_user(void *dst, const void *usrc, size_t size)
+{
+    return user_range_ok(usrc, size) && copy_user(dst, usrc, size);
+}
+
+/** Copies SIZE bytes from SRC to user address UDST.  Returns
+   false if the user memory is not writable. */
+bool copy_to_user(void *udst, const void *src, size_t size)
+{
+    return user_range_ok(udst, size) && copy_user(udst, src, size);
+}
+
+/** Copies the null-terminated string at user address USRC to
+   DST, a buffer of SIZE bytes, truncating it if necessary.
+   Returns the length of the string copied, SIZE if it did not
+   fit, or -1 if the user memory is not readable. */
+int strlcpy_from_user(char *dst, const char *usrc, size_t size)
+{
+    size_t len;
+
+    ASSERT(size > 0);
+    for (len = 0; len < size; len++)
+    {
+        uint8_t c;
+        int failed;
+
+        if (!user_range_ok(usrc + len, 1))
+            return -1;
+        asm volatile("movl $1, %0\n"
+                     "1: movb %2, %1\n"
+                     "movl $0, %0\n"
+                     "2:\n"
+                     EX_TABLE(1b, 2b)
+                     : "=&r"(failed), "=&q"(c) : "m"(usrc[len]));
+        if (failed)
+            return -1;
+        dst[len] = c;
+        if (c == '\0')
+            return len;
+    }
+    dst[size - 1] = '\0';
+    return size;
+}
@@ -0,0 +1,67 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/** Accessing user memory from the kernel.
+
+   These functions do not check user pointers against the page
+   tables.  They just access user memory, so that the common case
+   costs a bounds check and a load or store.  If the access faults
+   on memory the process cannot access, page_fault() finds the
+   faulting instruction in the exception table and resumes at its
+   fixup address, and the function reports failure.  Faults on
+   valid pages that are not loaded are handled as usual. */
+
+/** Returns true if the SIZE bytes at UADDR lie in user memory. */
+static inline bool user_range_ok(const void *uaddr, size_t size)
+{
+    uintptr_t start = (uintptr_t)uaddr;
+    return start + size >= start && start + size <= (uintptr_t)PHYS_BASE;
+}
+
+/** Adds an entry for the instruction at local label FROM to the
+   exception table, with the instruction at label TO as fixup. */
+#define EX_TABLE(FROM, TO)                  \
+    ".pushsection __ex_table, \"a\"\n"      \
+    ".long " #FROM ", " #TO "\n"            \
+    ".popsection\n"
+
+/** Reads the 32-bit word at user address UADDR into *DST.
+   Returns false if UADDR is not readable. */
+static inline bool get_user_u32(uint32_t *dst, const uint32_t *uaddr)
+{
+    int failed;
+    uint32_t value;
+
+    if (!user_range_ok(uaddr, sizeof *uaddr))
+        return false;
+    asm volatile("movl $1, %0\n"
+                 "1: movl %2, %1\n"
+                 "movl $0, %0\n"
+                 "2:\n"
+                 EX_TABLE(1b, 2b)
+                 : "=&r"(failed), "=&r"(value) : "m"(*uaddr));
+    if (failed)
+        return false;
+    *dst = value;
+    return true;
+}
+
+/** Entry of the exception table. */
+struct ex_table_entry
+{
+    uintptr_t insn;             /**< Instruction that may fault. */
+    uintptr_t fixup;            /**< Where to resume if it does. */
+};
+
+uintptr_t search_ex_table(uintptr_t insn);
+
+bool copy_from_user(void *dst, const void *usrc, size_t size);
+bool copy_to_user(void *udst, const void *src, size_t size);
+int strlcpy_from_user(char *dst, const char *usrc, size_t size);
+
+#endif /**< userprog/uaccess.h */
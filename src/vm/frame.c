@@ -1,34 +1,185 @@
 #include "vm/frame.h"
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/swap.h"
+#include "vm/wset.h"
 
 static struct list frame_table;
 static struct lock frame_lock;
 static struct list_elem* ptr = NULL;
 
-/** Init frame_table list and frame_lock. */
+/** Signaled with frame_lock when a frame stops being busy. */
+static struct condition io_done;
+
+/** The frame table entry of each page of the user pool, by its
+ *  number in the pool, or NULL if the page is not a frame.
+ */
+static struct frame_table_entry** frame_index;
+
+/** A kernel page of zeros shared by every page that has only
+ *  been read while it still holds nothing but zeros.  It is not
+ *  in the frame table and never evicted.
+ */
+static void* zero_frame;
+
+/** Init frame_table list, frame_lock and the zero frame. */
 void frame_table_init (void) {
     list_init(&frame_table);
     lock_init(&frame_lock);
+    cond_init(&io_done);
+    frame_index = calloc(palloc_user_page_cnt(), sizeof *frame_index);
+    if (frame_index == NULL)
+        PANIC("Frame table creation failed!");
+    zero_frame = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+}
+
+/** Returns the shared frame of zeros. */
+void* frame_zero(void) {
+    return zero_frame;
 }
 
-/** Returns whether a frame is dirty. */
+/** Returns the page directory a sharer is mapped in.  A process
+ *  releases its pages before it clears its page directory, so a
+ *  sharer always has one.
+ */
+static uint32_t* sharer_pagedir(struct sup_page_table_entry* spte) {
+    ASSERT(spte->owner->pagedir != NULL);
+    return spte->owner->pagedir;
+}
+
+/** Returns whether a frame is dirty in any page mapping it. */
 static bool is_frame_dirty(struct frame_table_entry* fte) {
-    struct thread* t = thread_current();
-    return pagedir_is_dirty(t->pagedir, fte->frame);
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        if (pagedir_is_dirty(pd, spte->vaddr))  return true;
+    }
+    return false;
 }
 
-/** Returns whether a frame is accessed. */
+/** Returns whether a frame is accessed through any page mapping it. */
 static bool is_page_accessed(struct frame_table_entry* fte) {
-    struct thread* t = thread_current();
-    return pagedir_is_accessed(t->pagedir, fte->frame);
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        if (pagedir_is_accessed(pd, spte->vaddr))  return true;
+    }
+    return false;
 }
 
-/** Set the accessed bit of a frame. */
-static void set_page_accessed(struct frame_table_entry* fte, bool accessed) {
-    struct thread* t = thread_current();
-    pagedir_set_accessed(t->pagedir, fte->frame, accessed);
+/** Count the frame in the working set of every process that
+ *  accessed it.
+ */
+static void sample_working_sets(struct frame_table_entry* fte) {
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        if (pagedir_is_accessed(pd, spte->vaddr))  wset_sample(spte->owner);
+    }
+}
+
+/** Clear the accessed bit of every page mapping a frame,
+ *  queueing the TLB invalidations in batch.
+ */
+static void clear_page_accessed(struct frame_table_entry* fte, struct tlb_batch* batch) {
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        pagedir_clear_accessed_batched(pd, spte->vaddr, batch);
+    }
+}
+
+/** Set the dirty bit of every page mapping a frame. */
+static void set_frame_dirty(struct frame_table_entry* fte) {
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        pagedir_set_dirty(pd, spte->vaddr, true);
+    }
+}
+
+/** Clear the dirty bit of every page mapping a frame. */
+static void clear_frame_dirty(struct frame_table_entry* fte) {
+    struct list_elem* e;
+    for (e = list_begin(&fte->sharers); e != list_end(&fte->sharers); e = list_next(e)) {
+        struct sup_page_table_entry* spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t* pd = sharer_pagedir(spte);
+        pagedir_set_dirty(pd, spte->vaddr, false);
+    }
+}
+
+/** Mark fte busy and pinned, and release frame_lock, so that a
+ *  frame can be written out without holding up every other page
+ *  fault.  No one else evicts or unmaps the frame until end_io().
+ */
+static void start_io(struct frame_table_entry* fte) {
+    ASSERT(!fte->busy);
+    fte->busy = true;
+    fte->pinned++;
+    lock_release(&frame_lock);
+}
+
+/** Take frame_lock again after start_io() and wake up the threads
+ *  waiting for fte.
+ */
+static void end_io(struct frame_table_entry* fte) {
+    lock_acquire(&frame_lock);
+    fte->busy = false;
+    fte->pinned--;
+    cond_broadcast(&io_done, &frame_lock);
+}
+
+/** Add spte to the pages mapping fte, counting the page as
+ *  resident in its process.  Must hold frame_lock.
+ */
+static void add_sharer(struct frame_table_entry* fte, struct sup_page_table_entry* spte) {
+    struct rusage* usage = &spte->owner->rusage;
+    list_push_back(&fte->sharers, &spte->frame_elem);
+    if (++usage->rss > usage->max_rss)
+        usage->max_rss = usage->rss;
+}
+
+/** Remove spte from the pages mapping its frame.  Must hold
+ *  frame_lock.
+ */
+static void remove_sharer(struct sup_page_table_entry* spte) {
+    list_remove(&spte->frame_elem);
+    spte->owner->rusage.rss--;
+}
+
+/** Write a mapped file page back to its file. */
+static void write_back(struct sup_page_table_entry* spte, void* frame) {
+    spte->owner->rusage.file_outs++;
+    file_write_at(spte->area->file, frame, vm_area_read_bytes(spte->area, spte->vaddr),
+                  vm_area_file_offset(spte->area, spte->vaddr));
+}
+
+/** Find the frame table entry of a frame.  Must hold frame_lock. */
+static struct frame_table_entry* find_fte(void* frame) {
+    return frame_index[palloc_user_page_no(frame)];
+}
+
+/** Free a frame and its entry.  Must hold frame_lock. */
+static void release_fte(struct frame_table_entry* fte) {
+    frame_index[palloc_user_page_no(fte->frame)] = NULL;
+    palloc_free_page(fte->frame);
+    if (ptr == &fte->elem) {
+        ptr = list_next(ptr);
+        if (ptr == list_end(&frame_table))
+            ptr = list_begin(&frame_table);
+    }
+    list_remove(&fte->elem);
+    free(fte);
 }
 
 /** Choose a victim to be swapped out.
@@ -39,21 +190,24 @@ static struct frame_table_entry* pick_victim_fifo(void) {
     struct list_elem* e;
     for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
         struct frame_table_entry* fte = list_entry(e, struct frame_table_entry, elem);
-        if (fte->pinned == false)  return fte;
+        if (fte->pinned == 0)  return fte;
     }
     return NULL;
 }
 */
 
-/** Choose a victim to be swapped out.
- *  Use clock algorithm.
+/** Advance the clock hand to the first unpinned frame that has
+ *  not been accessed, clearing accessed bits on the way.  The
+ *  accessed bits are sampled for the working set estimates, and
+ *  each turn of the hand starts a new sampling window.
  */
-static struct frame_table_entry* pick_victim(void) {
+static struct frame_table_entry* pick_victim_clock(struct tlb_batch* batch) {
     int flag = 0;
     while (1) {
         /* Deal with details to make it a circle list. */
         if (ptr == NULL || ptr == list_end(&frame_table)) {
             ptr = list_begin(&frame_table);
+            wset_window_end();
             /* If the frame table is scanned at least 2 rounds but 
                haven't found available frame to be swapped out, 
                there's no need to go on! */
@@ -66,37 +220,218 @@ static struct frame_table_entry* pick_victim(void) {
         ptr = list_next(ptr);
 
         /* Pinned frames is not available. */
-        if (fte->pinned == true)  continue;
+        if (fte->pinned > 0)  continue;
 
         if (is_page_accessed(fte) == false)  return fte;
-        set_page_accessed(fte, false);
+        sample_working_sets(fte);
+        clear_page_accessed(fte, batch);
     }
 }
 
-/** Evict one victim page when pages are not enough. */
-static void frame_evict(void) {
-    struct frame_table_entry* victim = pick_victim();
-    if (victim == NULL)  return;
+/** Choose a victim to be swapped out.
+ *  Use clock algorithm.  The accessed bits cleared on the way are
+ *  flushed from the TLB together once the hand stops.
+ */
+static struct frame_table_entry* pick_victim(void) {
+    struct tlb_batch batch;
+    tlb_batch_init(&batch);
+    struct frame_table_entry* victim = pick_victim_clock(&batch);
+    tlb_batch_flush(&batch);
+    return victim;
+}
 
-    /* If a frame is dirty, write back to swap slot and record the slot index. */
+/** Outcomes of evict(). */
+enum evict_result {
+    EVICT_DONE,                  /* the frame was freed */
+    EVICT_RACED,                 /* the frame was used while written out, and kept */
+    EVICT_NO_SLOT                /* no swap slot was left for the frame */
+};
+
+/** Write a frame out if it is dirty, unmap it from every page
+ *  mapping it and free it.  The write happens without frame_lock,
+ *  with the dirty bits cleared beforehand; if a page mapping the
+ *  frame was written to or pinned meanwhile, the frame is kept.
+ *  Must hold frame_lock.
+ */
+static enum evict_result evict(struct frame_table_entry* victim) {
+    /* If a frame is dirty, write back to swap slot.
+       Every page sharing the frame then refers to the slot.
+       Mapped files are never shared and go back to their file. */
+    int slot = SWAP_NONE;
     if (is_frame_dirty(victim)) {
-        int slot = swap_out(victim->frame);
-        if (slot == SWAP_ERROR)  PANIC("Swap out error!");
-        victim->spte->slot = slot;
+        struct sup_page_table_entry* first_spte =
+            list_entry(list_front(&victim->sharers), struct sup_page_table_entry, frame_elem);
+        bool mmap = first_spte->area->is_mmap;
+
+        clear_frame_dirty(victim);
+        start_io(victim);
+        if (mmap) {
+            write_back(first_spte, victim->frame);
+            end_io(victim);
+        } else {
+            slot = swap_out(victim->frame);
+            end_io(victim);
+            if (slot == SWAP_ERROR) {
+                set_frame_dirty(victim);
+                return EVICT_NO_SLOT;
+            }
+        }
+    }
+
+    /* Nothing may touch the pages between the check and the
+       unmapping, or a write could be lost. */
+    enum intr_level old_level = intr_disable();
+    if (victim->pinned > 0 || is_frame_dirty(victim)) {
+        intr_set_level(old_level);
+        set_frame_dirty(victim);
+        if (slot != SWAP_NONE)  swap_set(slot);
+        return EVICT_RACED;
     }
 
-    /* Remove the previous mapping in page directory. */
-    pagedir_clear_page(victim->thread->pagedir, victim->spte->vaddr);
+    /* Remove the previous mappings in page directories. */
+    int sharer_cnt = 0;
+    while (!list_empty(&victim->sharers)) {
+        struct sup_page_table_entry* spte =
+            list_entry(list_front(&victim->sharers), struct sup_page_table_entry, frame_elem);
+        remove_sharer(spte);
+        spte->owner->rusage.evictions++;
+        if (slot != SWAP_NONE)  spte->owner->rusage.swap_outs++;
+        uint32_t* pd = sharer_pagedir(spte);
+        pagedir_clear_page(pd, spte->vaddr);
+        spte->frame = NULL;
+        spte->slot = slot;
+        if (slot != SWAP_NONE)  spte->owner->rusage.swapped++;
+        sharer_cnt++;
+    }
+    intr_set_level(old_level);
+
+    /* Every sharer after the first takes another reference to the slot. */
+    for (; slot != SWAP_NONE && sharer_cnt > 1; sharer_cnt--)
+        swap_dup(slot);
 
     /* Free relevant data structure. */
-    palloc_free_page(victim->frame);
-    if (ptr == &victim->elem) {
-        ptr = list_next(ptr);
-        if (ptr == list_end(&frame_table))
-            ptr = list_begin(&frame_table);
-    } 
-    list_remove(&victim->elem);
-    free(victim);
+    release_fte(victim);
+    return EVICT_DONE;
+}
+
+/** Find an unpinned frame that can be evicted without a swap
+ *  slot: one that is clean, and so reads back from its file or as
+ *  zeros, or one of a mapped file, which is written back to it.
+ *  Searches from the clock hand.  Must hold frame_lock.
+ */
+static struct frame_table_entry* pick_clean_victim(void) {
+    struct list_elem* e = ptr != NULL ? ptr : list_begin(&frame_table);
+    for (size_t i = 0, n = list_size(&frame_table); i < n; i++, e = list_next(e)) {
+        if (e == list_end(&frame_table))
+            e = list_begin(&frame_table);
+        struct frame_table_entry* fte = list_entry(e, struct frame_table_entry, elem);
+        if (fte->pinned > 0)  continue;
+
+        struct sup_page_table_entry* spte =
+            list_entry(list_front(&fte->sharers), struct sup_page_table_entry, frame_elem);
+        if (spte->area->is_mmap || !is_frame_dirty(fte))  return fte;
+    }
+    return NULL;
+}
+
+/** Evict one victim page when pages are not enough.  When the
+ *  clock's victim needs a swap slot and none is left, a frame that
+ *  needs none is dropped instead.  Returns false if no frame can be
+ *  evicted, and true if one was or if the victim was used while it
+ *  was written out, since frames may have been freed meanwhile and
+ *  another victim may do.  Must hold frame_lock.
+ */
+static bool frame_evict(void) {
+    struct frame_table_entry* victim = pick_victim();
+    if (victim == NULL)  return false;
+    if (evict(victim) != EVICT_NO_SLOT)  return true;
+
+    victim = pick_clean_victim();
+    return victim != NULL && evict(victim) != EVICT_NO_SLOT;
+}
+
+/** Ticks to wait for a process killed for memory to exit. */
+#define OOM_WAIT_TICKS 100
+
+/** The process with the largest footprint in frames and swap
+ *  slots, among those that will get to exit: the current one and
+ *  those competing for frames, not those waiting for a child. */
+struct oom_choice {
+    struct thread* victim;
+    uint32_t footprint;
+};
+
+static void oom_select(struct thread* t, void* aux) {
+    struct oom_choice* choice = aux;
+    if (t->pagedir == NULL || (t != thread_current() && !t->ws_active))  return;
+
+    uint32_t footprint = t->rusage.rss + t->rusage.swapped;
+    if (choice->victim == NULL || footprint > choice->footprint) {
+        choice->victim = t;
+        choice->footprint = footprint;
+    }
+}
+
+/** Last resort when no frame can be evicted and swap is full:
+ *  kill the process with the largest footprint, and wait for it to
+ *  exit and release its frames and slots.  Another process notices
+ *  at its next page fault or system call.  Returns false if the
+ *  victim is the current process, which must then give up, or it
+ *  did not exit in time.  Must hold frame_lock, which is released
+ *  while waiting.
+ */
+static bool oom_kill(void) {
+    struct oom_choice choice = {NULL, 0};
+    enum intr_level old_level = intr_disable();
+    thread_foreach(oom_select, &choice);
+    intr_set_level(old_level);
+
+    struct thread* victim = choice.victim;
+    if (victim == NULL)  return false;
+    if (!victim->oom_killed)
+        printf("Out of memory: killing %s\n", victim->name);
+    victim->oom_killed = true;
+    if (victim == thread_current())  return false;
+
+    tid_t tid = victim->tid;
+    bool alive = true;
+    lock_release(&frame_lock);
+    for (int i = 0; i < OOM_WAIT_TICKS && alive; i++) {
+        timer_sleep(1);
+        old_level = intr_disable();
+        alive = get_thread(tid) != NULL;
+        intr_set_level(old_level);
+    }
+    lock_acquire(&frame_lock);
+    return !alive;
+}
+
+/** Get a page from the user pool when there is none left: evict a
+ *  victim, dropping a clean page if swap is full, and as a last
+ *  resort kill the largest process.  Must hold frame_lock.
+ */
+static void* get_user_page(enum palloc_flags flags) {
+    void* frame = palloc_get_page(flags);
+    while (frame == NULL) {
+        if (!frame_evict() && !oom_kill())  return NULL;
+        frame = palloc_get_page(flags);
+    }
+    return frame;
+}
+
+/** Record a frame mapped by spte.  Must hold frame_lock. */
+static struct frame_table_entry* add_fte(void* frame, struct sup_page_table_entry* spte, bool pinned) {
+    struct frame_table_entry* fte = malloc(sizeof(struct frame_table_entry));
+    if (fte == NULL)  return NULL;
+
+    fte -> frame = frame;
+    list_init(&fte -> sharers);
+    add_sharer(fte, spte);
+    fte -> pinned = pinned ? 1 : 0;
+    fte -> busy = false;
+    list_push_back(&frame_table, &fte -> elem);
+    frame_index[palloc_user_page_no(frame)] = fte;
+    return fte;
 }
 
 /** Alloc a frame and record the relevant information. */
@@ -107,31 +442,19 @@ void *frame_alloc (enum palloc_flags flags, struct sup_page_table_entry* spte, b
     ASSERT(flags & PAL_USER);
 
     /* Alloc a frame. */
-    void* frame = palloc_get_page(flags);
+    void* frame = get_user_page(flags);
     if (frame == NULL) {
-        /* If the first attempt fails, try to evict another frame. */
-        frame_evict();
-        frame = palloc_get_page(flags);
-        if (frame == NULL) {
-            lock_release(&frame_lock);
-            return NULL;
-        }
+        lock_release(&frame_lock);
+        return NULL;
     }
     
     /* Record relevant information. */
-    struct frame_table_entry* fte = malloc(sizeof(struct frame_table_entry));
-    if (fte == NULL) {
+    if (add_fte(frame, spte, pinned) == NULL) {
         palloc_free_page(frame);
         lock_release(&frame_lock);
         return NULL;
     }
 
-    fte -> frame = frame;
-    fte -> spte = spte;
-    fte -> pinned = pinned;
-    fte -> thread = thread_current();
-    list_push_back(&frame_table, &fte -> elem);
-
     lock_release(&frame_lock);
     return frame;
 }
@@ -140,41 +463,219 @@ void *frame_alloc (enum palloc_flags flags, struct sup_page_table_entry* spte, b
 void frame_free (void *frame) {
     lock_acquire(&frame_lock);
 
-    struct list_elem* e;
-    for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        struct frame_table_entry* fte = list_entry(e, struct frame_table_entry, elem);
-        if (fte -> frame == frame) {
-            palloc_free_page(frame);
-            if (ptr == e) {
-                ptr = list_next(ptr);
-                if (ptr == list_end(&frame_table))
-                    ptr = list_begin(&frame_table);
-            } 
-            list_remove(e);
-            free(fte);
-            lock_release(&frame_lock);
-            return;
+    struct frame_table_entry* fte = find_fte(frame);
+    if (fte != NULL) {
+        while (!list_empty(&fte->sharers)) {
+            struct sup_page_table_entry* spte =
+                list_entry(list_front(&fte->sharers), struct sup_page_table_entry, frame_elem);
+            remove_sharer(spte);
+            spte->frame = NULL;
         }
+        release_fte(fte);
+        lock_release(&frame_lock);
+        return;
     }
 
     lock_release(&frame_lock);
     PANIC("Tried to free an unallocated frame!");
 }
 
-/* Let a frame able to be swapped out. */
+/** Pin the frame of spte, so that it is not swapped out until
+ *  frame_depin().  Pins nest.  Returns false if spte is not
+ *  resident.
+ */
+bool frame_pin(struct sup_page_table_entry* spte) {
+    lock_acquire(&frame_lock);
+
+    bool resident = spte->frame != NULL;
+    if (resident)
+        find_fte(spte->frame)->pinned++;
+
+    lock_release(&frame_lock);
+    return resident;
+}
+
+/* Drop a pin of a frame, letting it be swapped out once no pins are left. */
 void frame_depin(void* frame) {
     lock_acquire(&frame_lock);
 
-    struct list_elem* e;
-    for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        struct frame_table_entry* fte = list_entry(e, struct frame_table_entry, elem);
-        if (fte -> frame == frame) {
-            fte->pinned = false;
-            lock_release(&frame_lock);
-            return;
-        }
+    struct frame_table_entry* fte = find_fte(frame);
+    if (fte != NULL) {
+        ASSERT(fte->pinned > 0);
+        fte->pinned--;
+        lock_release(&frame_lock);
+        return;
     }
 
     lock_release(&frame_lock);
     PANIC("Tried to depin an unallocated page!");
-}
\ No newline at end of file
+}
+
+/** Share whatever backs spte with copy, a page of a forked child.
+ *  A resident frame is mapped read-only in both processes, and
+ *  the first write to it is handled by frame_cow().  A swap slot
+ *  just gains a reference.  Returns false if the child's page
+ *  table cannot be extended.
+ */
+bool frame_share(struct sup_page_table_entry* spte, struct sup_page_table_entry* copy) {
+    bool success = true;
+    lock_acquire(&frame_lock);
+
+    if (spte->frame != NULL) {
+        struct frame_table_entry* fte = find_fte(spte->frame);
+        uint32_t* pd = spte->owner->pagedir;
+        bool dirty = pagedir_is_dirty(pd, spte->vaddr);
+
+        if (spte->area->writable)  pagedir_set_writable(pd, spte->vaddr, false);
+        success = pagedir_set_page(copy->owner->pagedir, copy->vaddr, spte->frame, false);
+        if (success) {
+            /* The child must remember the frame differs from its file. */
+            pagedir_set_dirty(copy->owner->pagedir, copy->vaddr, dirty);
+            copy->frame = spte->frame;
+            add_sharer(fte, copy);
+        }
+    }
+    else if (spte->slot != SWAP_NONE) {
+        swap_dup(spte->slot);
+        copy->slot = spte->slot;
+        copy->owner->rusage.swapped++;
+    }
+
+    lock_release(&frame_lock);
+    return success;
+}
+
+/** Handle a write to a present page shared copy-on-write.
+ *  The last page mapping a frame simply gets it writable again;
+ *  otherwise spte gets a private copy.  Returns false if no frame
+ *  can be found for the copy.
+ */
+bool frame_cow(struct sup_page_table_entry* spte) {
+    lock_acquire(&frame_lock);
+
+    /* The frame was evicted before we got here, the retried
+       access will fault it back in. */
+    if (spte->frame == NULL) {
+        lock_release(&frame_lock);
+        return true;
+    }
+
+    struct frame_table_entry* fte = find_fte(spte->frame);
+    uint32_t* pd = spte->owner->pagedir;
+    if (list_size(&fte->sharers) == 1) {
+        pagedir_set_writable(pd, spte->vaddr, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+
+    /* Keep the source from being chosen as the victim. */
+    fte->pinned++;
+    void* frame = get_user_page(PAL_USER);
+    fte->pinned--;
+    if (frame == NULL) {
+        lock_release(&frame_lock);
+        return false;
+    }
+
+    /* The other pages may have dropped the frame while frame_lock
+       was released to evict one. */
+    if (list_size(&fte->sharers) == 1) {
+        palloc_free_page(frame);
+        pagedir_set_writable(pd, spte->vaddr, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+
+    remove_sharer(spte);
+    if (add_fte(frame, spte, false) == NULL) {
+        add_sharer(fte, spte);
+        palloc_free_page(frame);
+        lock_release(&frame_lock);
+        return false;
+    }
+    memcpy(frame, fte->frame, PGSIZE);
+
+    /* The copy exists nowhere else, so it must be swapped out if evicted. */
+    pagedir_clear_page(pd, spte->vaddr);
+    pagedir_set_page(pd, spte->vaddr, frame, true);
+    pagedir_set_dirty(pd, spte->vaddr, true);
+    spte->frame = frame;
+
+    lock_release(&frame_lock);
+    return true;
+}
+
+/** Drop spte's reference to the frame or swap slot backing it.
+ *  The frame is freed when spte was the last page mapping it,
+ *  after writing it back if it maps a file and was written to.
+ *  A frame being written out is waited for first.  The mapping in
+ *  the page directory is left alone.
+ */
+void frame_unmap(struct sup_page_table_entry* spte) {
+    lock_acquire(&frame_lock);
+
+    while (spte->frame != NULL && find_fte(spte->frame)->busy)
+        cond_wait(&io_done, &frame_lock);
+
+    if (spte->frame != NULL) {
+        struct frame_table_entry* fte = find_fte(spte->frame);
+        if (spte->area->is_mmap && is_frame_dirty(fte)) {
+            start_io(fte);
+            write_back(spte, fte->frame);
+            end_io(fte);
+        }
+        remove_sharer(spte);
+        if (list_empty(&fte->sharers))  release_fte(fte);
+        spte->frame = NULL;
+    }
+    else if (spte->slot != SWAP_NONE) {
+        swap_set(spte->slot);
+        spte->slot = SWAP_NONE;
+        spte->owner->rusage.swapped--;
+    }
+
+    lock_release(&frame_lock);
+}
+
+/** Move the frame of spte, if resident and not pinned, to the
+ *  clock hand with its accessed bits clear, so that it is the next
+ *  victim unless it is used again before the hand moves on.
+ */
+void frame_deactivate(struct sup_page_table_entry* spte) {
+    lock_acquire(&frame_lock);
+
+    if (spte->frame != NULL) {
+        struct frame_table_entry* fte = find_fte(spte->frame);
+        if (fte->pinned == 0) {
+            struct tlb_batch batch;
+            tlb_batch_init(&batch);
+            clear_page_accessed(fte, &batch);
+            tlb_batch_flush(&batch);
+
+            if (ptr != &fte->elem) {
+                list_remove(&fte->elem);
+                list_insert(ptr != NULL ? ptr : list_end(&frame_table), &fte->elem);
+                ptr = &fte->elem;
+            }
+        }
+    }
+
+    lock_release(&frame_lock);
+}
+
+/** Evict the frame of spte now, if it is resident, not pinned and
+ *  mapped by spte alone.  Returns whether it was evicted.
+ */
+bool frame_page_out(struct sup_page_table_entry* spte) {
+    lock_acquire(&frame_lock);
+
+    bool evicted = false;
+    if (spte->frame != NULL) {
+        struct frame_table_entry* fte = find_fte(spte->frame);
+        if (fte->pinned == 0 && list_size(&fte->sharers) == 1)
+            evicted = evict(fte) == EVICT_DONE;
+    }
+
+    lock_release(&frame_lock);
+    return evicted;
+}
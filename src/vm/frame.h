@@ -1,3 +1,6 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
@@ -9,9 +12,9 @@
 struct frame_table_entry
 {
     void *frame;                        /* frame address */
-    struct sup_page_table_entry *spte;  /* relevant information in supplemental page table */
-    bool pinned;                        /* whether it can be swapped out */
-    struct thread* thread;              /* the thread owning the frame */
+    struct list sharers;                /* sup_page_table_entries mapping the frame */
+    int pinned;                         /* pins keeping it from being swapped out */
+    bool busy;                          /* being written out without frame_lock */
     struct list_elem elem;
 };
 
@@ -22,5 +25,25 @@ void frame_table_init(void);
 void *frame_alloc (enum palloc_flags flags, struct sup_page_table_entry* spte, bool pinned);
 void frame_free(void *frame);
 
-/** Let the frame able to be swapped out. */
-void frame_depin(void *frame);
\ No newline at end of file
+/** The frame of zeros mapped read-only by untouched zero pages. */
+void *frame_zero(void);
+
+/** Keep a page's frame from being swapped out, and let it be
+    swapped out again. */
+bool frame_pin(struct sup_page_table_entry* spte);
+void frame_depin(void *frame);
+
+/** Copy-on-write sharing of frames between forked processes. */
+bool frame_share(struct sup_page_table_entry* spte, struct sup_page_table_entry* copy);
+bool frame_cow(struct sup_page_table_entry* spte);
+
+/** Drop a page's reference to its frame or swap slot. */
+void frame_unmap(struct sup_page_table_entry* spte);
+
+/** Make a page's frame the next one the clock considers. */
+void frame_deactivate(struct sup_page_table_entry* spte);
+
+/** Evict a page's frame right away. */
+bool frame_page_out(struct sup_page_table_entry* spte);
+
+#endif /**< vm/frame.h */
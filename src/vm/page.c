@@ -1,6 +1,631 @@
 #include "vm/page.h"
+#include <round.h>
+#include <string.h>
+#include "userprog/pagedir.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
 
-/** Init the supplemental page table. */
-void sup_page_table_init(struct list* sup_page_table_addr) {
-    list_init(sup_page_table_addr);
+/** Number of pages loaded ahead of a file-backed page fault.
+ *  Set by the kernel command-line option "-fa=N".
+ */
+size_t fault_around_pages = 4;
+
+/** Maximum size of a process's stack in bytes.
+ *  Set by the kernel command-line option "-sl=N" in kB.
+ */
+size_t stack_limit = 8 * 1024 * 1024;
+
+static unsigned page_hash(const struct hash_elem* e, void* aux UNUSED) {
+    const struct sup_page_table_entry* spte = hash_entry(e, struct sup_page_table_entry, elem);
+    return hash_bytes(&spte->vaddr, sizeof spte->vaddr);
+}
+
+static bool page_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+    return hash_entry(a, struct sup_page_table_entry, elem)->vaddr
+         < hash_entry(b, struct sup_page_table_entry, elem)->vaddr;
+}
+
+/** Init the supplemental page table and areas of the current
+ *  process.  Returns false if memory runs out.
+ */
+bool sup_page_table_init(void) {
+    struct thread* t = thread_current();
+    list_init(&t->vm_areas);
+    t->vm_area_cache = NULL;
+    t->next_mapid = 0;
+    return hash_init(&t->sup_page_table, page_hash, page_less, NULL);
+}
+
+/** Add the area of size bytes at start to the current process.
+ *  The first read_bytes bytes come from file at file_offset, the
+ *  rest is zero.  Areas are kept sorted by start address; pages
+ *  are only created when first touched, so this costs the same
+ *  for any size.  Returns NULL if memory runs out.
+ */
+struct vm_area* vm_area_create(void* start, size_t size, struct file* file,
+                               off_t file_offset, uint32_t read_bytes, bool writable) {
+    ASSERT(pg_ofs(start) == 0 && size % PGSIZE == 0);
+
+    struct vm_area* area = malloc(sizeof(struct vm_area));
+    if (area == NULL)  return NULL;
+    area->start = start;
+    area->end = (uint8_t*)start + size;
+    area->file = file;
+    area->file_offset = file_offset;
+    area->read_bytes = file != NULL ? read_bytes : 0;
+    area->writable = writable;
+    area->is_mmap = false;
+    area->mapid = -1;
+    area->advice = MADV_NORMAL;
+
+    struct list* list = &thread_current()->vm_areas;
+    struct list_elem* e;
+    for (e = list_begin(list); e != list_end(list); e = list_next(e))
+        if (list_entry(e, struct vm_area, elem)->start > start)  break;
+    list_insert(e, &area->elem);
+    return area;
+}
+
+/** Find the area of the current process covering addr, trying
+ *  the last area found first since faults tend to cluster.
+ */
+struct vm_area* vm_area_find(const void* addr) {
+    struct thread* t = thread_current();
+    struct vm_area* area = t->vm_area_cache;
+    if (area != NULL && addr >= area->start && addr < area->end)
+        return area;
+
+    struct list_elem* e;
+    for (e = list_begin(&t->vm_areas); e != list_end(&t->vm_areas); e = list_next(e)) {
+        area = list_entry(e, struct vm_area, elem);
+        if (addr < area->start)  break;
+        if (addr < area->end) {
+            t->vm_area_cache = area;
+            return area;
+        }
+    }
+    return NULL;
+}
+
+/** Grow the stack of the current process down to the fault
+ *  address addr, if addr looks like a stack access: no more than
+ *  32 bytes below the user stack pointer esp (as PUSHA does) and
+ *  within stack_limit of the top of user memory.  The stack also
+ *  takes up to STACK_PREFAULT_PAGES pages below addr, so that
+ *  sup_page_table_prefault_stack() can map them ahead.  The stack
+ *  never grows into the area below it.  Returns the stack area,
+ *  or NULL if addr is not a stack access.
+ */
+struct vm_area* vm_area_grow_stack(const void* addr, const void* esp) {
+    struct list* list = &thread_current()->vm_areas;
+    if (list_empty(list))  return NULL;
+
+    /* The stack is the area at the top of user memory. */
+    struct vm_area* stack = list_entry(list_back(list), struct vm_area, elem);
+    if (stack->end != PHYS_BASE || stack->is_mmap)  return NULL;
+
+    uint8_t* upage = pg_round_down(addr);
+    uint8_t* limit = (uint8_t*)PHYS_BASE - ROUND_UP(stack_limit, PGSIZE);
+    if ((const uint8_t*)addr + 32 < (const uint8_t*)esp
+        || upage < limit || upage >= (uint8_t*)stack->start)
+        return NULL;
+
+    uint8_t* start = (size_t)(upage - limit) > STACK_PREFAULT_PAGES * PGSIZE
+                   ? upage - STACK_PREFAULT_PAGES * PGSIZE : limit;
+    if (list_prev(&stack->elem) != list_head(list)) {
+        struct vm_area* below = list_entry(list_prev(&stack->elem), struct vm_area, elem);
+        if ((uint8_t*)below->end > upage)  return NULL;
+        if ((uint8_t*)below->end > start)  start = below->end;
+    }
+    stack->start = start;
+    return stack;
+}
+
+/** Remove area from the current process and free it. */
+static void vm_area_remove(struct vm_area* area) {
+    struct thread* t = thread_current();
+    if (t->vm_area_cache == area)
+        t->vm_area_cache = NULL;
+    list_remove(&area->elem);
+    if (area->is_mmap)
+        file_close(area->file);
+    free(area);
+}
+
+/** Offset in the area's file of the page upage. */
+off_t vm_area_file_offset(const struct vm_area* area, const void* upage) {
+    return area->file_offset + ((const uint8_t*)upage - (const uint8_t*)area->start);
+}
+
+/** Number of bytes of the page upage read from the area's file;
+ *  the rest of the page is zero.
+ */
+uint32_t vm_area_read_bytes(const struct vm_area* area, const void* upage) {
+    uint32_t ofs = (const uint8_t*)upage - (const uint8_t*)area->start;
+    if (ofs >= area->read_bytes)  return 0;
+    return area->read_bytes - ofs < PGSIZE ? area->read_bytes - ofs : PGSIZE;
+}
+
+/** Find the state of page upage of the current process, or NULL
+ *  if it was never loaded.
+ */
+struct sup_page_table_entry* sup_page_table_find(const void* upage) {
+    struct sup_page_table_entry key;
+    key.vaddr = pg_round_down(upage);
+    struct hash_elem* e = hash_find(&thread_current()->sup_page_table, &key.elem);
+    return e != NULL ? hash_entry(e, struct sup_page_table_entry, elem) : NULL;
+}
+
+/** Find the state of page upage of area, creating it if the page
+ *  was never loaded.  Returns NULL if memory runs out.
+ */
+static struct sup_page_table_entry* sup_page_table_get(struct vm_area* area, void* upage) {
+    struct sup_page_table_entry* spte = sup_page_table_find(upage);
+    if (spte != NULL)  return spte;
+
+    spte = malloc(sizeof(struct sup_page_table_entry));
+    if (spte == NULL)  return NULL;
+    spte->vaddr = upage;
+    spte->area = area;
+    spte->frame = NULL;
+    spte->slot = SWAP_NONE;
+    spte->owner = thread_current();
+    hash_insert(&spte->owner->sup_page_table, &spte->elem);
+    return spte;
+}
+
+/** Adds a mapping from user virtual address UPAGE to kernel
+ *  virtual address KPAGE to the current process's page table.
+ *  Returns false if UPAGE is already mapped or if memory
+ *  allocation fails.
+ */
+static bool install_page(void* upage, void* kpage, bool writable) {
+    struct thread* t = thread_current();
+
+    /* Verify that there's not already a page at that virtual
+       address, then map our page there. */
+    return (pagedir_get_page(t->pagedir, upage) == NULL && pagedir_set_page(t->pagedir, upage, kpage, writable));
+}
+
+/** Load page upage of area into a new frame, from swap, from its
+ *  file, or as zeros, and map it, leaving the frame pinned if
+ *  pinned is true.  If data is not NULL, it holds the file
+ *  contents of the page, already read.  Returns false if no frame
+ *  can be found or the file cannot be read.
+ */
+static bool load_page(struct vm_area* area, void* upage, bool pinned, const void* data) {
+    struct sup_page_table_entry* spte = sup_page_table_get(area, upage);
+    if (spte == NULL)  return false;
+
+    /* Get a page of memory. */
+    uint8_t* kpage = frame_alloc(PAL_USER | PAL_ZERO, spte, true);
+    if (kpage == NULL)  return false;
+    spte->frame = kpage;
+
+    /* Load a page from swap slot. */
+    bool from_swap = spte->slot != SWAP_NONE;
+    if (from_swap) {
+        swap_in(spte->slot, kpage);
+        spte->slot = SWAP_NONE;
+        spte->owner->rusage.swap_ins++;
+        spte->owner->rusage.swapped--;
+    }
+
+    /* Lazy loading of the area's file contents. */
+    else {
+        uint32_t read_bytes = vm_area_read_bytes(area, upage);
+        if (read_bytes > 0 && data != NULL)
+            memcpy(kpage, data, read_bytes);
+        else if (read_bytes > 0
+            && file_read_at(area->file, kpage, read_bytes, vm_area_file_offset(area, upage)) != (int)read_bytes) {
+            frame_free(kpage);
+            return false;
+        }
+        if (read_bytes > 0)
+            spte->owner->rusage.file_ins++;
+    }
+
+    /* Replace the shared zero frame on the first write. */
+    uint32_t* pd = thread_current()->pagedir;
+    if (pagedir_get_page(pd, upage) == frame_zero())
+        pagedir_clear_page(pd, upage);
+
+    /* Add the page to the process's address space. */
+    if (!install_page(upage, kpage, area->writable)) {
+        frame_free(kpage);
+        return false;
+    }
+
+    /* The slot is gone, so the page must go back to swap when evicted. */
+    if (from_swap)
+        pagedir_set_dirty(pd, upage, true);
+
+    if (!pinned)
+        frame_depin(kpage);
+    return true;
+}
+
+/** Load page upage of area into a new frame, from swap, from its
+ *  file, or as zeros, and map it.  Returns false if no frame can
+ *  be found or the file cannot be read.
+ */
+bool sup_page_table_load(struct vm_area* area, void* upage) {
+    return load_page(area, upage, false, NULL);
+}
+
+/** Map the shared zero frame read-only at upage, if the page would
+ *  load as all zeros: it has no file contents and is neither
+ *  resident nor in swap.  The first write faults and gets a
+ *  private frame from sup_page_table_load().  Returns false if the
+ *  page does not qualify or cannot be mapped.
+ */
+bool sup_page_table_map_zero(struct vm_area* area, void* upage) {
+    if (vm_area_read_bytes(area, upage) != 0)  return false;
+    struct sup_page_table_entry* spte = sup_page_table_find(upage);
+    if (spte != NULL && (spte->frame != NULL || spte->slot != SWAP_NONE))
+        return false;
+    return install_page(upage, frame_zero(), false);
+}
+
+/** Number of pages read ahead of a fault in area: none if its
+ *  access is random, twice as many if it is sequential.
+ */
+static size_t fault_around_window(const struct vm_area* area) {
+    if (area->advice == MADV_RANDOM)  return 0;
+    if (area->advice == MADV_SEQUENTIAL)  return 2 * fault_around_pages;
+    return fault_around_pages;
+}
+
+/** Load up to fault_around_pages pages of area following upage
+ *  that have file contents and are neither resident nor in swap,
+ *  so that running through code or a mapped file takes one fault
+ *  per window instead of one per page.  The pages are mapped with
+ *  their accessed bits clear, so the clock evicts them first if
+ *  they turn out to be unused.  Returns the number of pages loaded.
+ */
+size_t sup_page_table_fault_around(struct vm_area* area, void* upage) {
+    size_t window = fault_around_window(area);
+    uint8_t* next = (uint8_t*)upage + PGSIZE;
+    size_t cnt;
+    for (cnt = 0; cnt < window && (void*)next < area->end; cnt++, next += PGSIZE) {
+        if (vm_area_read_bytes(area, next) == 0)  break;
+        struct sup_page_table_entry* spte = sup_page_table_find(next);
+        if (spte != NULL && (spte->frame != NULL || spte->slot != SWAP_NONE))  break;
+        if (!sup_page_table_load(area, next))  break;
+    }
+    return cnt;
+}
+
+/** Map the pages of the stack area below upage that were never
+ *  loaded, after vm_area_grow_stack() extended the stack past
+ *  them, so that deep recursion takes one fault per few pages.
+ *  Returns the number of pages mapped.
+ */
+size_t sup_page_table_prefault_stack(struct vm_area* area, void* upage) {
+    size_t cnt = 0;
+    for (uint8_t* page = area->start; page < (uint8_t*)upage; page += PGSIZE) {
+        if (sup_page_table_find(page) != NULL)  continue;
+        if (!sup_page_table_load(area, page))  break;
+        cnt++;
+    }
+    return cnt;
+}
+
+/** Pages of file contents read at once by sup_page_table_populate(). */
+#define POPULATE_CHUNK 16
+
+/** Load every page of area that has file contents and was never
+ *  loaded, reading the file in runs of up to POPULATE_CHUNK pages
+ *  rather than one page per fault.  Falls back to a read per page
+ *  if no buffer for a run is available, and stops early if frames
+ *  run out.  Returns the number of pages loaded.
+ */
+size_t sup_page_table_populate(struct vm_area* area) {
+    uint8_t* buf = palloc_get_multiple(0, POPULATE_CHUNK);
+    size_t max_run = buf != NULL ? POPULATE_CHUNK : 1;
+    uint8_t* upage = area->start;
+    size_t cnt = 0;
+
+    while ((void*)upage < area->end && vm_area_read_bytes(area, upage) > 0) {
+        if (sup_page_table_find(upage) != NULL) {
+            upage += PGSIZE;
+            continue;
+        }
+
+        /* Gather the following pages that were never loaded either.
+           Only the last page of an area's contents can be partial,
+           so the run is contiguous in the file. */
+        size_t run = 1;
+        uint32_t bytes = vm_area_read_bytes(area, upage);
+        for (uint8_t* next = upage + PGSIZE; run < max_run && (void*)next < area->end;
+             next += PGSIZE, run++) {
+            uint32_t read_bytes = vm_area_read_bytes(area, next);
+            if (read_bytes == 0 || sup_page_table_find(next) != NULL)  break;
+            bytes += read_bytes;
+        }
+
+        if (buf == NULL) {
+            if (!load_page(area, upage, false, NULL))  break;
+            cnt++;
+        } else {
+            if (file_read_at(area->file, buf, bytes, vm_area_file_offset(area, upage)) != (int)bytes)
+                break;
+            size_t i;
+            for (i = 0; i < run; i++)
+                if (!load_page(area, upage + i * PGSIZE, false, buf + i * PGSIZE))  break;
+            cnt += i;
+            if (i < run)  break;
+        }
+        upage += run * PGSIZE;
+    }
+
+    palloc_free_multiple(buf, POPULATE_CHUNK);
+    return cnt;
+}
+
+/** Let the clock take first the resident pages of a sequentially
+ *  accessed area that the access stream has just passed: the
+ *  pages behind upage back to the previous fault.
+ */
+void sup_page_table_reclaim_behind(struct vm_area* area, void* upage) {
+    size_t cnt = fault_around_window(area) + 1;
+    uint8_t* page = upage;
+    while (cnt-- > 0 && page > (uint8_t*)area->start) {
+        page -= PGSIZE;
+        struct sup_page_table_entry* spte = sup_page_table_find(page);
+        if (spte != NULL)  frame_deactivate(spte);
+    }
+}
+
+/** Copy the areas and pages of parent into the current process.
+ *  Resident pages and swap slots are shared copy-on-write rather
+ *  than copied, so fork() costs no page copies up front.
+ *  Returns false if memory runs out; what was copied so far is
+ *  released when the child exits.
+ */
+bool sup_page_table_copy(struct thread* parent) {
+    struct thread* child = thread_current();
+
+    /* Like exec(), fork() does not inherit file mappings. */
+    struct list_elem* e;
+    for (e = list_begin(&parent->vm_areas); e != list_end(&parent->vm_areas); e = list_next(e)) {
+        struct vm_area* area = list_entry(e, struct vm_area, elem);
+        if (area->is_mmap)  continue;
+
+        struct vm_area* copy = malloc(sizeof(struct vm_area));
+        if (copy == NULL)  return false;
+        *copy = *area;
+        list_push_back(&child->vm_areas, &copy->elem);
+    }
+
+    struct hash_iterator i;
+    hash_first(&i, &parent->sup_page_table);
+    while (hash_next(&i)) {
+        struct sup_page_table_entry* spte = hash_entry(hash_cur(&i), struct sup_page_table_entry, elem);
+        if (spte->area->is_mmap)  continue;
+
+        struct sup_page_table_entry* copy = sup_page_table_get(vm_area_find(spte->vaddr), spte->vaddr);
+        if (copy == NULL || !frame_share(spte, copy))  return false;
+    }
+    return true;
+}
+
+/** Map file into consecutive pages starting at addr.
+ *  Pages are only read in when first accessed.  The mapping uses
+ *  its own handle on the file, so closing or removing the file
+ *  does not affect it.  Returns the mapping id, or -1 if the file
+ *  is empty, addr is not a free page-aligned range of user
+ *  memory, or memory runs out.
+ */
+int sup_page_table_mmap(struct file* file, void* addr) {
+    struct thread* t = thread_current();
+    off_t length = file_length(file);
+    if (length == 0 || addr == NULL || pg_ofs(addr) != 0)  return -1;
+
+    /* The whole range must lie in user space and be unused. */
+    size_t page_cnt = DIV_ROUND_UP(length, PGSIZE);
+    uint8_t* end = (uint8_t*)addr + page_cnt * PGSIZE;
+    if (end <= (uint8_t*)addr || end > (uint8_t*)PHYS_BASE)  return -1;
+    struct list_elem* e;
+    for (e = list_begin(&t->vm_areas); e != list_end(&t->vm_areas); e = list_next(e)) {
+        struct vm_area* area = list_entry(e, struct vm_area, elem);
+        if ((uint8_t*)area->start < end && addr < area->end)  return -1;
+    }
+
+    struct file* reopened = file_reopen(file);
+    if (reopened == NULL)  return -1;
+    struct vm_area* area = vm_area_create(addr, page_cnt * PGSIZE, reopened, 0, length, true);
+    if (area == NULL) {
+        file_close(reopened);
+        return -1;
+    }
+    area->is_mmap = true;
+    area->mapid = t->next_mapid++;
+    return area->mapid;
+}
+
+/** Make page upage of the current process resident and keep it
+ *  so until sup_page_table_unpin(), with a private writable frame
+ *  if write is true.  A page that is only read while it holds
+ *  nothing but zeros gets the zero frame, which is never evicted,
+ *  instead.  Returns false if upage is not a valid address of the
+ *  process for the access.
+ */
+static bool pin_page(void* upage, bool write) {
+    struct vm_area* area = vm_area_find(upage);
+    if (area == NULL)
+        area = vm_area_grow_stack(upage, thread_current()->user_esp);
+    if (area == NULL || (write && !area->writable))  return false;
+
+    for (;;) {
+        struct sup_page_table_entry* spte = sup_page_table_find(upage);
+        if (spte != NULL && spte->frame != NULL) {
+            /* Resolve copy-on-write now rather than faulting on the
+               first write.  Either step fails if the page was
+               evicted meanwhile, and then it is loaded again. */
+            if (write && !frame_cow(spte))  return false;
+            if (frame_pin(spte))  return true;
+            continue;
+        }
+        if (!write && (pagedir_get_page(thread_current()->pagedir, upage) == frame_zero()
+                       || sup_page_table_map_zero(area, upage)))
+            return true;
+        return load_page(area, upage, true, NULL);
+    }
+}
+
+/** Make the size bytes of user memory at buffer resident and keep
+ *  them so until sup_page_table_unpin(), checking that the current
+ *  process may access them, for writing if write is true.  System
+ *  calls use this before handing a user buffer to code that must
+ *  not page fault.  Returns false, with nothing left pinned, if
+ *  part of the buffer is not valid.
+ */
+bool sup_page_table_pin(const void* buffer, size_t size, bool write) {
+    if (size == 0)  return true;
+    uint8_t* first = pg_round_down(buffer);
+    uint8_t* last = pg_round_down((const uint8_t*)buffer + size - 1);
+    if ((const uint8_t*)buffer + size < (const uint8_t*)buffer || !is_user_vaddr(last))
+        return false;
+
+    for (uint8_t* upage = first; upage <= last; upage += PGSIZE)
+        if (!pin_page(upage, write)) {
+            if (upage > first)
+                sup_page_table_unpin(first, upage - first);
+            return false;
+        }
+    return true;
+}
+
+/** Release the pages pinned by sup_page_table_pin(). */
+void sup_page_table_unpin(const void* buffer, size_t size) {
+    if (size == 0)  return;
+    uint8_t* last = pg_round_down((const uint8_t*)buffer + size - 1);
+    for (uint8_t* upage = pg_round_down(buffer); upage <= last; upage += PGSIZE) {
+        struct sup_page_table_entry* spte = sup_page_table_find(upage);
+        if (spte != NULL && spte->frame != NULL)
+            frame_depin(spte->frame);
+    }
+}
+
+/** Drop page upage of the current process: release its frame or
+ *  swap slot, writing a mapped file page back first, and unmap
+ *  it.  Its next access loads it again like a new page.
+ */
+static void sup_page_table_drop(void* upage) {
+    struct thread* t = thread_current();
+    struct sup_page_table_entry* spte = sup_page_table_find(upage);
+    if (spte != NULL) {
+        frame_unmap(spte);
+        hash_delete(&t->sup_page_table, &spte->elem);
+        free(spte);
+    }
+    pagedir_clear_page(t->pagedir, upage);
+}
+
+/** Unmap the mapping mapid of the current process.  Pages that
+ *  were written to are written back to the file.  Unknown ids
+ *  are ignored.
+ */
+void sup_page_table_munmap(int mapid) {
+    struct thread* t = thread_current();
+    struct list_elem* e;
+    struct vm_area* area = NULL;
+    for (e = list_begin(&t->vm_areas); e != list_end(&t->vm_areas); e = list_next(e))
+        if (list_entry(e, struct vm_area, elem)->is_mmap
+            && list_entry(e, struct vm_area, elem)->mapid == mapid) {
+            area = list_entry(e, struct vm_area, elem);
+            break;
+        }
+    if (area == NULL)  return;
+
+    for (uint8_t* upage = area->start; upage < (uint8_t*)area->end; upage += PGSIZE)
+        sup_page_table_drop(upage);
+    vm_area_remove(area);
+}
+
+/** Load page upage of area ahead of use if it has contents in
+ *  swap or in its file and is not resident.
+ */
+static void sup_page_table_prefetch(struct vm_area* area, void* upage) {
+    struct sup_page_table_entry* spte = sup_page_table_find(upage);
+    if (spte != NULL && spte->frame != NULL)  return;
+    if ((spte == NULL || spte->slot == SWAP_NONE) && vm_area_read_bytes(area, upage) == 0)
+        return;
+    sup_page_table_load(area, upage);
+}
+
+/** Apply the access hint advice, one of MADV_*, to the pages of
+ *  the current process from addr for length bytes.  NORMAL, RANDOM
+ *  and SEQUENTIAL set the read-ahead and reclaim policy of every
+ *  area the range touches.  WILLNEED loads the pages that are in
+ *  swap or in a file now.  DONTNEED drops the pages, freeing their
+ *  frames and swap slots: mapped files are written back first,
+ *  other pages read back from their file or as zeros.  Returns 0,
+ *  or -1 if addr is not page aligned, advice is unknown, or part
+ *  of the range is not mapped.
+ */
+int sup_page_table_madvise(void* addr, size_t length, int advice) {
+    if (pg_ofs(addr) != 0 || advice < MADV_NORMAL || advice > MADV_DONTNEED)  return -1;
+    uint8_t* end = (uint8_t*)addr + ROUND_UP(length, PGSIZE);
+    if (end < (uint8_t*)addr || end > (uint8_t*)PHYS_BASE)  return -1;
+
+    uint8_t* upage;
+    for (upage = addr; upage < end; upage = vm_area_find(upage)->end)
+        if (vm_area_find(upage) == NULL)  return -1;
+
+    upage = addr;
+    while (upage < end) {
+        struct vm_area* area = vm_area_find(upage);
+        uint8_t* area_end = (uint8_t*)area->end < end ? area->end : end;
+        if (advice == MADV_WILLNEED)
+            for (; upage < area_end; upage += PGSIZE)
+                sup_page_table_prefetch(area, upage);
+        else if (advice == MADV_DONTNEED)
+            for (; upage < area_end; upage += PGSIZE)
+                sup_page_table_drop(upage);
+        else {
+            area->advice = advice;
+            upage = area_end;
+        }
+    }
+    return 0;
+}
+
+/** Evict every resident page of the current process that is not
+ *  pinned or shared with another process, e.g. when it is
+ *  suspended.  Returns the number of pages evicted.
+ */
+size_t sup_page_table_page_out(void) {
+    struct hash_iterator i;
+    size_t cnt = 0;
+
+    hash_first(&i, &thread_current()->sup_page_table);
+    while (hash_next(&i)) {
+        struct sup_page_table_entry* spte = hash_entry(hash_cur(&i), struct sup_page_table_entry, elem);
+        if (frame_page_out(spte))  cnt++;
+    }
+    return cnt;
+}
+
+static void page_destroy(struct hash_elem* e, void* aux UNUSED) {
+    struct sup_page_table_entry* spte = hash_entry(e, struct sup_page_table_entry, elem);
+    frame_unmap(spte);
+    free(spte);
+}
+
+/** Release the frames and swap slots of the current process,
+ *  writing mapped files back, and free its pages and areas.  The
+ *  page directory is destroyed separately, so the mappings
+ *  themselves are left in place.
+ */
+void sup_page_table_destroy(void) {
+    struct thread* t = thread_current();
+    hash_destroy(&t->sup_page_table, page_destroy);
+    while (!list_empty(&t->vm_areas))
+        vm_area_remove(list_entry(list_front(&t->vm_areas), struct vm_area, elem));
 }
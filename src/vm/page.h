@@ -1,20 +1,93 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include <syscall-nr.h>
 #include "filesys/file.h"
 
+struct thread;
+
+/* A range of pages of a process with the same backing and
+   protection: an ELF segment, the stack, or a mapped file. */
+struct vm_area{
+    void* start;                 /* first page of the area */
+    void* end;                   /* end of the area, page aligned */
+    struct file* file;           /* source file, NULL for zeros */
+    off_t file_offset;           /* offset of start in file */
+    uint32_t read_bytes;         /* bytes read from file, the rest is zero */
+    bool writable;               /* whether the pages are writable */
+    bool is_mmap;                /* whether the area maps a file by mmap() */
+    int mapid;                   /* mapping identifier if is_mmap */
+    int advice;                  /* access hint, one of MADV_* */
+    struct list_elem elem;       /* element in the process's vm_areas */
+};
+
+/* State of one page of a vm_area, created when the page is first
+   loaded and kept while it is resident or in swap. */
 struct sup_page_table_entry{
     void* vaddr;                 /* virtual address */
-    bool is_loaded;              /* whether the page has been loaded */
-    struct file* file;           /* source file */
-    off_t file_offset;
-    uint32_t read_bytes;
-    uint32_t zero_bytes;
-    bool writable;               /* whether the page is writable */
-    struct list_elem elem;
+    struct vm_area* area;        /* the area the page belongs to */
     void* frame;                 /* the frame allocated to the page */
     int slot;                    /* the swap slot index */
+    struct thread* owner;        /* the process the page belongs to */
+    struct list_elem frame_elem; /* element in the frame's sharers list */
+    struct hash_elem elem;       /* element in the supplemental page table */
 };
 
-/* Init the supplemental page table. */
-void sup_page_table_init(struct list* sup_page_table_addr);
+/* Pages loaded ahead of a file-backed page fault ("-fa=N"). */
+extern size_t fault_around_pages;
+
+/* Maximum size of a process's stack in bytes ("-sl=N" in kB). */
+extern size_t stack_limit;
+
+/* Stack pages mapped below a fault that grows the stack. */
+#define STACK_PREFAULT_PAGES 2
+
+/* Init the supplemental page table and areas of the current process. */
+bool sup_page_table_init(void);
+
+/* Add and look up areas of the current process. */
+struct vm_area* vm_area_create(void* start, size_t size, struct file* file,
+                               off_t file_offset, uint32_t read_bytes, bool writable);
+struct vm_area* vm_area_find(const void* addr);
+struct vm_area* vm_area_grow_stack(const void* addr, const void* esp);
+
+/* Where a page of an area comes from in its file. */
+off_t vm_area_file_offset(const struct vm_area* area, const void* upage);
+uint32_t vm_area_read_bytes(const struct vm_area* area, const void* upage);
+
+/* Find the state of a loaded page of the current process. */
+struct sup_page_table_entry* sup_page_table_find(const void* upage);
+
+/* Load a page on a page fault, and the file pages following it. */
+bool sup_page_table_load(struct vm_area* area, void* upage);
+bool sup_page_table_map_zero(struct vm_area* area, void* upage);
+size_t sup_page_table_fault_around(struct vm_area* area, void* upage);
+size_t sup_page_table_prefault_stack(struct vm_area* area, void* upage);
+size_t sup_page_table_populate(struct vm_area* area);
+void sup_page_table_reclaim_behind(struct vm_area* area, void* upage);
+
+/* Keep user buffers resident while the kernel uses them. */
+bool sup_page_table_pin(const void* buffer, size_t size, bool write);
+void sup_page_table_unpin(const void* buffer, size_t size);
+
+/* Apply a madvise() access hint to a range of pages. */
+int sup_page_table_madvise(void* addr, size_t length, int advice);
+
+/* Evict the private resident pages of the current process. */
+size_t sup_page_table_page_out(void);
+
+/* Copy the address space of a process into a forked child. */
+bool sup_page_table_copy(struct thread* parent);
+
+/* Map and unmap files in the current process. */
+int sup_page_table_mmap(struct file* file, void* addr);
+void sup_page_table_munmap(int mapid);
+
+/* Release all pages and areas of the current process. */
+void sup_page_table_destroy(void);
+
+#endif /**< vm/page.h */
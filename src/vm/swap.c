@@ -1,73 +1,214 @@
 #include "vm/swap.h"
+#include <stdio.h>
 #include "devices/block.h"
 #include "lib/kernel/bitmap.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/malloc.h"
 
-#define K PGSIZE / BLOCK_SECTOR_SIZE
+#define K (PGSIZE / BLOCK_SECTOR_SIZE)
 
-struct block* swap_slot;
-block_sector_t slot_count;
-struct bitmap* swap_map;
-struct lock swap_lock;
+/** A slot number names a device in its top bits and a page of
+   that device in the rest. */
+#define SLOT_DEV_SHIFT 24
+#define SLOT_PAGE_MASK ((1 << SLOT_DEV_SHIFT) - 1)
+#define SLOT_DEV(SLOT) ((SLOT) >> SLOT_DEV_SHIFT)
+#define SLOT_PAGE(SLOT) ((SLOT) & SLOT_PAGE_MASK)
 
-/** Get the swap block device and update its size.
- *  Create bitmap and set all bits usable.
- *  Init swap_lock used in this part.
- */
+/** A block device used for swap. */
+struct swap_device {
+    struct block* block;         /* the device */
+    int priority;                /* higher priorities are used first */
+    size_t page_cnt;             /* number of page slots */
+    size_t free_cnt;             /* number of unused page slots */
+    size_t cursor;               /* where the next search for a slot starts */
+    struct bitmap* used;         /* one bit per page slot */
+    unsigned* refs;              /* pages referring to each slot */
+    long long write_cnt;         /* pages written to the device */
+    long long read_cnt;          /* pages read from the device */
+};
+
+/** Swap devices in decreasing order of priority. */
+static struct swap_device swap_devs[SWAP_DEV_MAX];
+static int swap_dev_cnt;
+
+/** For the devices sharing the priority of swap_devs[i] and
+   following it, the offset of the next one to write to, so that
+   swap traffic is striped across them. */
+static int swap_rotor[SWAP_DEV_MAX];
+
+/** Protects the slot maps and reference counts, not the I/O. */
+static struct lock swap_lock;
+
+/** Add BLOCK as a swap device with the given PRIORITY. */
+void swap_add_device(struct block* block, int priority) {
+    if (swap_dev_cnt >= SWAP_DEV_MAX)
+        PANIC("Too many swap devices!");
+
+    size_t page_cnt = block_size(block) / K;
+    if (page_cnt > SLOT_PAGE_MASK + 1)
+        page_cnt = SLOT_PAGE_MASK + 1;
+
+    /* Keep the array sorted by priority, after earlier devices
+       of the same priority. */
+    int i = swap_dev_cnt++;
+    for (; i > 0 && swap_devs[i - 1].priority < priority; i--)
+        swap_devs[i] = swap_devs[i - 1];
+
+    struct swap_device* dev = &swap_devs[i];
+    dev->block = block;
+    dev->priority = priority;
+    dev->page_cnt = page_cnt;
+    dev->free_cnt = page_cnt;
+    dev->cursor = 0;
+    dev->used = bitmap_create(page_cnt);
+    dev->refs = calloc(page_cnt, sizeof *dev->refs);
+    dev->write_cnt = dev->read_cnt = 0;
+    if (dev->used == NULL || dev->refs == NULL)
+        PANIC("Swap slot map creation failed!");
+}
+
+/** Check that swap devices exist and init swap_lock. */
 void swap_slot_init(void) {
-    swap_slot = block_get_role(BLOCK_SWAP);
-    if (swap_slot == NULL)
+    if (swap_dev_cnt == 0)
         PANIC("Swap slot not exists!");
-
-    slot_count = block_size(swap_slot);
-    swap_map = bitmap_create(slot_count);
-    bitmap_set_all(swap_map, 0);
     lock_init(&swap_lock);
 }
 
-/** Swap out pages and record the bits used in bitmap. */
+/** Get the device of SLOT and check that it is in use. */
+static struct swap_device* slot_device(int slot) {
+    ASSERT(slot >= 0 && SLOT_DEV(slot) < swap_dev_cnt);
+    struct swap_device* dev = &swap_devs[SLOT_DEV(slot)];
+    ASSERT((size_t) SLOT_PAGE(slot) < dev->page_cnt);
+    return dev;
+}
+
+/** Take a free page slot on DEV, starting from its cursor. */
+static size_t device_alloc(struct swap_device* dev) {
+    ASSERT(dev->free_cnt > 0);
+    size_t page = bitmap_scan_and_flip(dev->used, dev->cursor, 1, false);
+    if (page == BITMAP_ERROR)
+        page = bitmap_scan_and_flip(dev->used, 0, 1, false);
+    ASSERT(page != BITMAP_ERROR);
+
+    dev->free_cnt--;
+    dev->cursor = page + 1 < dev->page_cnt ? page + 1 : 0;
+    dev->refs[page] = 1;
+    return page;
+}
+
+/** Take a free slot from the highest priority device that has one,
+   turning between devices of equal priority.
+   Returns SWAP_ERROR if all devices are full. */
+static int slot_alloc(void) {
+    for (int i = 0, j; i < swap_dev_cnt; i = j) {
+        for (j = i + 1; j < swap_dev_cnt && swap_devs[j].priority == swap_devs[i].priority; j++)
+            continue;
+
+        int n = j - i;
+        for (int k = 0; k < n; k++) {
+            int d = i + (swap_rotor[i] + k) % n;
+            if (swap_devs[d].free_cnt > 0) {
+                swap_rotor[i] = (swap_rotor[i] + k + 1) % n;
+                return (d << SLOT_DEV_SHIFT) | device_alloc(&swap_devs[d]);
+            }
+        }
+    }
+    return SWAP_ERROR;
+}
+
+/** Drop one reference to SLOT.
+   The slot becomes usable once nobody refers to it. */
+static void swap_unref(int slot) {
+    struct swap_device* dev = slot_device(slot);
+    size_t page = SLOT_PAGE(slot);
+
+    ASSERT(dev->refs[page] > 0);
+    if (--dev->refs[page] == 0) {
+        bitmap_reset(dev->used, page);
+        dev->free_cnt++;
+    }
+}
+
+/** Swap out a page and return its slot.
+   Only the slot allocation is serialized: devices on different
+   IDE channels write concurrently. */
 int swap_out(void* frame) {
     lock_acquire(&swap_lock);
-
-    /* Find K continuous usable bits and set all of them being used. */
-    block_sector_t pos = bitmap_scan_and_flip(swap_map, 0, K, 0);
-    if (pos == BITMAP_ERROR) {
-        lock_release(&swap_lock);
+    int slot = slot_alloc();
+    lock_release(&swap_lock);
+    if (slot == SWAP_ERROR)
         return SWAP_ERROR;
-    }
-    
-    /* Write contents into swap slot page by page. */
+
+    /* Write contents into swap slot sector by sector. */
+    struct swap_device* dev = slot_device(slot);
+    block_sector_t sector = (block_sector_t) SLOT_PAGE(slot) * K;
     for (int offset = 0, cnt = 0; offset < PGSIZE; offset += BLOCK_SECTOR_SIZE, cnt++)
-        block_write(swap_slot, pos + cnt, (char*)frame + offset);
-    lock_release(&swap_lock);
-    return pos;
-}
+        block_write(dev->block, sector + cnt, (char*)frame + offset);
 
-/** Swap in pages and update the bitmap. */
-void swap_in(int pos, void* frame) {
     lock_acquire(&swap_lock);
+    dev->write_cnt++;
+    lock_release(&swap_lock);
+    return slot;
+}
 
-    /* Ensure that pos is valid. */
-    ASSERT(pos >= 0 && pos + K <= slot_count);
+/** Swap in a page and drop the caller's reference to the slot.
+   The slot cannot be reused during the read since the caller
+   still holds its reference. */
+void swap_in(int slot, void* frame) {
+    struct swap_device* dev = slot_device(slot);
 
-    /* Read contents from swap slot page by page. */
+    /* Read contents from swap slot sector by sector. */
+    block_sector_t sector = (block_sector_t) SLOT_PAGE(slot) * K;
     for (int offset = 0, cnt = 0; offset < PGSIZE; offset += BLOCK_SECTOR_SIZE, cnt++)
-        block_read(swap_slot, pos + cnt, frame + offset);
+        block_read(dev->block, sector + cnt, (char*)frame + offset);
 
-    /* Set all K bits usable. */
-    bitmap_set_multiple(swap_map, pos, K, 0);
+    lock_acquire(&swap_lock);
+    dev->read_cnt++;
+    swap_unref(slot);
+    lock_release(&swap_lock);
+}
 
+/* Drop a reference to the slot without reading it. */
+void swap_set(int slot) {
+    lock_acquire(&swap_lock);
+    swap_unref(slot);
     lock_release(&swap_lock);
 }
 
-/* Set K continuous bits from pos usable. */
-void swap_set(int pos) {
+/* Add a reference to the slot, e.g. when fork() shares it. */
+void swap_dup(int slot) {
     lock_acquire(&swap_lock);
 
-    /* Ensure that pos is valid and set all K bits usable. */
-    ASSERT(pos >= 0 && pos + K <= slot_count);
-    bitmap_set_multiple(swap_map, pos, K, 0);
+    struct swap_device* dev = slot_device(slot);
+    size_t page = SLOT_PAGE(slot);
+    ASSERT(dev->refs[page] > 0);
+    dev->refs[page]++;
 
     lock_release(&swap_lock);
 }
+
+/** Print statistics about swap usage. */
+void swap_print_stats(void) {
+    long long writes = 0, reads = 0;
+    size_t used = 0, total = 0;
+
+    if (swap_dev_cnt == 0)  return;
+    for (int i = 0; i < swap_dev_cnt; i++) {
+        struct swap_device* dev = &swap_devs[i];
+        writes += dev->write_cnt;
+        reads += dev->read_cnt;
+        used += dev->page_cnt - dev->free_cnt;
+        total += dev->page_cnt;
+    }
+    printf("Swap: %lld pages written, %lld pages read, %zu of %zu slots in use\n",
+           writes, reads, used, total);
+
+    if (swap_dev_cnt > 1)
+        for (int i = 0; i < swap_dev_cnt; i++) {
+            struct swap_device* dev = &swap_devs[i];
+            printf("  %s (priority %d): %lld written, %lld read, %zu of %zu slots in use\n",
+                   block_name(dev->block), dev->priority, dev->write_cnt, dev->read_cnt,
+                   dev->page_cnt - dev->free_cnt, dev->page_cnt);
+        }
+}
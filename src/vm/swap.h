@@ -1,3 +1,6 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
@@ -5,6 +8,15 @@
 #define SWAP_ERROR -1
 #define SWAP_NONE -1
 
+/** Maximum number of swap devices. */
+#define SWAP_DEV_MAX 8
+
+struct block;
+
+/** Add a swap device.  Devices of higher priority are filled
+    first; pages are striped across devices of equal priority. */
+void swap_add_device(struct block* block, int priority);
+
 /** Init data structures and constants about swap slot. */
 void swap_slot_init(void);
 
@@ -14,3 +26,11 @@ void swap_in(int pos, void* frame);
 
 /** Set pages usable in swap slot. */
 void swap_set(int pos);
+
+/** Share a swap slot with another page. */
+void swap_dup(int pos);
+
+/** Print statistics about swap usage. */
+void swap_print_stats(void);
+
+#endif /**< vm/swap.h */
@@ -0,0 +1,198 @@
+#include "vm/wset.h"
+#include <list.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "vm/page.h"
+
+/** Smallest working set assumed for a process, so that one that
+ *  has not been sampled yet still counts.
+ */
+#define WSET_MIN_PAGES 8
+
+/** Current sampling window: one turn of the clock hand.  The clock
+ *  only turns when frames run short, so windows measure how many
+ *  pages a process references between two visits of the hand.
+ */
+static unsigned wset_window;
+
+/** Processes competing for frames, the most recently admitted
+ *  last, and the lock protecting the list and the waits below.
+ */
+static struct list active_procs;
+static struct lock wset_lock;
+
+/** Signalled when the demand for frames may have dropped. */
+static struct condition room;
+static int waiter_cnt;
+
+/** Number of frames in the user pool. */
+static size_t frame_cnt;
+
+/** Number of admissions delayed and processes suspended. */
+static long long delay_cnt;
+static long long suspend_cnt;
+
+/** Init the list of active processes and count the frames. */
+void wset_init(void) {
+    list_init(&active_procs);
+    lock_init(&wset_lock);
+    cond_init(&room);
+    frame_cnt = palloc_user_page_cnt();
+}
+
+/** Count a referenced page of t in the current window, closing
+ *  the window t was last sampled in first.  Must hold frame_lock.
+ */
+void wset_sample(struct thread* t) {
+    if (t->ws_window != wset_window) {
+        t->ws_estimate = wset_estimate(t);
+        t->ws_referenced = 0;
+        t->ws_window = wset_window;
+    }
+    t->ws_referenced++;
+}
+
+/** Start a new sampling window.  Must hold frame_lock. */
+void wset_window_end(void) {
+    wset_window++;
+}
+
+/** Returns the estimated working set of t: the average of the
+ *  pages it referenced in the windows it was sampled in, halved
+ *  for every later window in which it referenced none.
+ */
+size_t wset_estimate(const struct thread* t) {
+    unsigned missed = wset_window - t->ws_window;
+    size_t estimate;
+
+    if (missed == 0)
+        estimate = t->ws_estimate > t->ws_referenced ? t->ws_estimate : t->ws_referenced;
+    else {
+        estimate = (t->ws_estimate + t->ws_referenced) / 2;
+        estimate >>= missed - 1 < 16 ? missed - 1 : 16;
+    }
+    return estimate > WSET_MIN_PAGES ? estimate : WSET_MIN_PAGES;
+}
+
+/** Returns the sum of the working sets of the active processes.
+ *  Must hold wset_lock.
+ */
+static size_t demand(void) {
+    size_t sum = 0;
+    struct list_elem* e;
+    for (e = list_begin(&active_procs); e != list_end(&active_procs); e = list_next(e))
+        sum += wset_estimate(list_entry(e, struct thread, ws_elem));
+    return sum;
+}
+
+/** Wait until a working set of pages fits next to those of the
+ *  active processes, or none is left, then join them.  Must hold
+ *  wset_lock.
+ */
+static void wait_and_join(size_t pages) {
+    struct thread* t = thread_current();
+
+    waiter_cnt++;
+    while (!list_empty(&active_procs) && demand() + pages > frame_cnt)
+        cond_wait(&room, &wset_lock);
+    waiter_cnt--;
+
+    list_push_back(&active_procs, &t->ws_elem);
+    t->ws_active = true;
+    t->ws_estimate = pages;
+    t->ws_referenced = 0;
+    t->ws_window = t->ws_checked = wset_window;
+}
+
+/** Admit the current process among those competing for frames,
+ *  delaying it while their working sets already fill memory.  A
+ *  process is always admitted when no other one competes, so the
+ *  system makes progress.
+ */
+void wset_admit(void) {
+    lock_acquire(&wset_lock);
+    if (!list_empty(&active_procs) && demand() + WSET_MIN_PAGES > frame_cnt)
+        delay_cnt++;
+    wait_and_join(WSET_MIN_PAGES);
+    lock_release(&wset_lock);
+}
+
+/** Remove the current process from those competing for frames,
+ *  while it waits for a child or exits.  Must hold wset_lock.
+ */
+static void leave(void) {
+    struct thread* t = thread_current();
+    if (!t->ws_active)  return;
+
+    list_remove(&t->ws_elem);
+    t->ws_active = false;
+    if (waiter_cnt > 0)
+        cond_broadcast(&room, &wset_lock);
+}
+
+void wset_leave(void) {
+    lock_acquire(&wset_lock);
+    leave();
+    lock_release(&wset_lock);
+}
+
+/** Make the current process compete for frames again after
+ *  wset_leave(), without waiting: a parent back from waiting for
+ *  a child may be the one others wait for.
+ */
+void wset_rejoin(void) {
+    struct thread* t = thread_current();
+
+    lock_acquire(&wset_lock);
+    if (!t->ws_active && t->pagedir != NULL) {
+        list_push_back(&active_procs, &t->ws_elem);
+        t->ws_active = true;
+        t->ws_window = t->ws_checked = wset_window;
+    }
+    lock_release(&wset_lock);
+}
+
+/** Suspend the current process: leave the active processes, page
+ *  out its frames, and wait until its working set fits again.  Its
+ *  pages fault back in once it runs.
+ */
+static void suspend(void) {
+    size_t pages = wset_estimate(thread_current());
+
+    suspend_cnt++;
+    leave();
+    lock_release(&wset_lock);
+
+    sup_page_table_page_out();
+
+    lock_acquire(&wset_lock);
+    wait_and_join(pages);
+}
+
+/** Called on user page faults, outside of any kernel lock.  Once
+ *  per sampling window, checks whether the working sets of the
+ *  active processes exceed the frames.  If so, the most recently
+ *  admitted one suspends itself, so the others stop thrashing;
+ *  otherwise waiting processes get to check whether they fit.
+ */
+void wset_checkpoint(void) {
+    struct thread* t = thread_current();
+    if (!t->ws_active || t->ws_checked == wset_window)  return;
+
+    lock_acquire(&wset_lock);
+    t->ws_checked = wset_window;
+    if (demand() > frame_cnt) {
+        if (list_back(&active_procs) == &t->ws_elem && list_size(&active_procs) > 1)
+            suspend();
+    }
+    else if (waiter_cnt > 0)
+        cond_broadcast(&room, &wset_lock);
+    lock_release(&wset_lock);
+}
+
+/** Print statistics about admission control. */
+void wset_print_stats(void) {
+    printf("Working sets: %lld admissions delayed, %lld processes suspended\n",
+           delay_cnt, suspend_cnt);
+}
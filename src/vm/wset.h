@@ -0,0 +1,30 @@
+#ifndef VM_WSET_H
+#define VM_WSET_H
+
+#include <debug.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+/** Init working set estimation and admission control. */
+void wset_init(void);
+
+/** Count a page of a process found referenced by the clock, and
+    start a new sampling window once the clock has gone round. */
+void wset_sample(struct thread* t);
+void wset_window_end(void);
+
+/** Estimated working set of a process in pages. */
+size_t wset_estimate(const struct thread* t);
+
+/** Enter and leave the processes competing for frames. */
+void wset_admit(void);
+void wset_leave(void);
+void wset_rejoin(void);
+
+/** Let the current process be suspended if frames are overcommitted. */
+void wset_checkpoint(void);
+
+/** Print statistics about admission control. */
+void wset_print_stats(void);
+
+#endif /**< vm/wset.h */